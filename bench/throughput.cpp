@@ -0,0 +1,439 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/* Replays VT streams into a terminal widget and reports how fast they are
+ * parsed and painted. No shell is started: the streams are written to the
+ * slave side of an empty pty, so every run sees exactly the same bytes.
+ *
+ * Without arguments a built-in corpus is generated from a fixed seed. Files
+ * given on the command line (e.g. recorded with `script -q -c htop out.raw`)
+ * are replayed instead.
+ */
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QTimer>
+
+#include <algorithm>
+#include <random>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "properties.h"
+#include "termwidget.h"
+
+// the generated streams are laid out for this screen size
+#define BENCH_COLUMNS 80
+#define BENCH_LINES 24
+// time given to the terminal to paint its last frame
+#define SETTLE_MS 250
+
+const char* const short_options = "hs:f:";
+
+const struct option long_options[] = {
+    {"help",       0, NULL, 'h'},
+    {"size",       1, NULL, 's'},
+    {"frame-rate", 1, NULL, 'f'},
+    {NULL,         0, NULL,  0}
+};
+
+void print_usage_and_exit(int code)
+{
+    puts("Usage: qterminal_bench_throughput [OPTION]... [FILE]...\n");
+    puts("  -f,  --frame-rate <fps>   Repaint limit during floods, 0 paints every update");
+    puts("  -h,  --help               Print this help");
+    puts("  -s,  --size <MiB>         Size of each generated stream (default 8)");
+    puts("\nReplays the given raw pty recordings, or a generated corpus without FILE.");
+    exit(code);
+}
+
+
+namespace {
+
+struct Stream
+{
+    QByteArray name;
+    QByteArray data;
+};
+
+struct Result
+{
+    qint64 bytes;
+    qint64 lines;
+    qint64 nsecs;
+    QVector<qint64> frames;
+};
+
+typedef std::mt19937 Rng;
+
+int pick(Rng & rng, int n)
+{
+    return rng() % n;
+}
+
+QByteArray word(Rng & rng, int min, int max)
+{
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz_";
+    QByteArray w;
+    int len = min + pick(rng, max - min + 1);
+    for (int i = 0; i < len; ++i)
+        w += letters[pick(rng, sizeof(letters) - 1)];
+    return w;
+}
+
+QByteArray moveTo(int row, int column)
+{
+    return "\x1b[" + QByteArray::number(row) + ';' + QByteArray::number(column) + 'H';
+}
+
+QByteArray lsRecursive(Rng & rng, int size)
+{
+    static const char * const modes[] = {
+        "-rw-r--r--", "-rwxr-xr-x", "drwxr-xr-x", "lrwxrwxrwx", "-rw-------"
+    };
+    QByteArray out;
+    QByteArray dir(".");
+    while (out.size() < size)
+    {
+        out += dir + ":\r\ntotal " + QByteArray::number(pick(rng, 5000)) + "\r\n";
+        int entries = 1 + pick(rng, 40);
+        for (int i = 0; i < entries; ++i)
+        {
+            out += QByteArray(modes[pick(rng, 5)]) + ' ' + QByteArray::number(1 + pick(rng, 9))
+                   + " user group " + QByteArray::number(pick(rng, 1 << 20)).rightJustified(8)
+                   + " Oct " + QByteArray::number(1 + pick(rng, 28)).rightJustified(2)
+                   + ' ' + QByteArray::number(pick(rng, 24)).rightJustified(2, '0')
+                   + ':' + QByteArray::number(pick(rng, 60)).rightJustified(2, '0')
+                   + ' ' + word(rng, 3, 20) + '.' + word(rng, 1, 3) + "\r\n";
+        }
+        out += "\r\n";
+        dir = pick(rng, 3) ? dir + '/' + word(rng, 3, 10) : QByteArray(".");
+    }
+    return out;
+}
+
+QByteArray compilerLog(Rng & rng, int size)
+{
+    QByteArray out;
+    int percent = 0;
+    while (out.size() < size)
+    {
+        QByteArray file = "src/" + word(rng, 4, 12) + ".cpp";
+        out += "[" + QByteArray::number(percent).rightJustified(3) + "%] \x1b[32mBuilding CXX object "
+               "CMakeFiles/app.dir/" + file + ".o\x1b[0m\r\n";
+        percent = (percent + 1) % 101;
+        if (pick(rng, 4))
+            continue;
+
+        QByteArray line = QByteArray::number(1 + pick(rng, 3000));
+        QByteArray column = QByteArray::number(1 + pick(rng, 80));
+        QByteArray name = word(rng, 1, 12);
+        bool error = !pick(rng, 5);
+        out += "\x1b[01m\x1b[K" + file + ':' + line + ':' + column + ":\x1b[m\x1b[K "
+               + (error ? "\x1b[01;31m\x1b[Kerror: " : "\x1b[01;35m\x1b[Kwarning: ")
+               + "\x1b[m\x1b[Kunused variable \xe2\x80\x98\x1b[01m\x1b[K" + name
+               + "\x1b[m\x1b[K\xe2\x80\x99 [\x1b[01;35m\x1b[K-Wunused-variable\x1b[m\x1b[K]\r\n"
+               + "  " + line.rightJustified(4) + " |     int \x1b[01;35m\x1b[K" + name
+               + "\x1b[m\x1b[K = " + QByteArray::number(pick(rng, 100)) + ";\r\n"
+               + "       |         \x1b[01;35m\x1b[K^" + QByteArray(name.size() - 1, '~')
+               + "\x1b[m\x1b[K\r\n";
+    }
+    return out;
+}
+
+QByteArray vimScrolling(Rng & rng, int size)
+{
+    static const char * const colors[] = { "\x1b[33m", "\x1b[36m", "\x1b[35m", "\x1b[32m", "\x1b[m" };
+    QByteArray out("\x1b[?1049h\x1b[22;0;0t\x1b[1;" + QByteArray::number(BENCH_LINES - 1) + "r\x1b[H\x1b[2J");
+    int line = 0;
+    while (out.size() < size)
+    {
+        // scroll the text region by one line and draw the new bottom line
+        out += "\x1b[?25l" + moveTo(BENCH_LINES - 1, 1) + "\n\x1b[K\x1b[33m"
+               + QByteArray::number(++line).rightJustified(5) + " \x1b[m";
+        int words = pick(rng, 10);
+        for (int i = 0; i < words; ++i)
+            out += colors[pick(rng, 5)] + word(rng, 2, 8) + ' ';
+        out += "\x1b[m" + moveTo(BENCH_LINES, 1) + "\x1b[K\x1b[7m src/main.cpp "
+               + QByteArray::number(line) + ",1 \x1b[m" + moveTo(BENCH_LINES - 1, 7) + "\x1b[?25h";
+    }
+    return out + "\x1b[r\x1b[?1049l\x1b[23;0;0t";
+}
+
+QByteArray htop(Rng & rng, int size)
+{
+    QByteArray out("\x1b[?1049h\x1b[?25l\x1b[H\x1b[2J");
+    while (out.size() < size)
+    {
+        for (int cpu = 0; cpu < 4; ++cpu)
+        {
+            int used = pick(rng, 30);
+            out += moveTo(cpu + 1, 1) + "\x1b[36m" + QByteArray::number(cpu) + "\x1b[39m\x1b[1m[\x1b[22m\x1b[32m"
+                   + QByteArray(used, '|') + "\x1b[31m" + QByteArray(pick(rng, 30 - used + 1), '|')
+                   + "\x1b[K" + moveTo(cpu + 1, 34) + "\x1b[39m" + QByteArray::number(pick(rng, 1000) / 10.0, 'f', 1) + "%]";
+        }
+        out += moveTo(6, 1) + "\x1b[30;42m  PID USER      PRI  NI  VIRT   RES   SHR S CPU% MEM%   TIME+  Command\x1b[K\x1b[m";
+        for (int row = 7; row <= BENCH_LINES; ++row)
+        {
+            out += moveTo(row, 1) + (row == 7 ? "\x1b[30;46m" : "\x1b[m")
+                   + QByteArray::number(1 + pick(rng, 32767)).rightJustified(5)
+                   + " user       20   0 " + QByteArray::number(pick(rng, 999)).rightJustified(4) + "M "
+                   + QByteArray::number(pick(rng, 999)).rightJustified(4) + "M "
+                   + QByteArray::number(pick(rng, 99)).rightJustified(4) + "M S "
+                   + QByteArray::number(pick(rng, 1000) / 10.0, 'f', 1).rightJustified(4) + ' '
+                   + QByteArray::number(pick(rng, 1000) / 10.0, 'f', 1).rightJustified(4) + "  0:"
+                   + QByteArray::number(pick(rng, 60)).rightJustified(2, '0') + ".00 \x1b[1m"
+                   + word(rng, 3, 12) + "\x1b[K";
+        }
+    }
+    return out + "\x1b[m\x1b[?25h\x1b[?1049l";
+}
+
+QByteArray unicodeHeavy(Rng & rng, int size)
+{
+    // CJK and emoji take two cells, the combining accent none
+    static const char * const samples[] = {
+        "\xe6\xbc\xa2\xe5\xad\x97", "\xe3\x81\x8b\xe3\x81\xaa", "\xed\x95\x9c\xea\xb8\x80",
+        "\xf0\x9f\x98\x80", "\xf0\x9f\x9a\x80", "e\xcc\x81", "\xd0\x9f\xd1\x80\xd0\xb8",
+        "\xce\xb1\xce\xb2\xce\xb3", "\xe2\x94\x80\xe2\x94\x82\xe2\x94\x8c", "\xe2\x96\x88\xe2\x96\x91",
+        "\xd7\xa9\xd7\x9c\xd7\x95\xd7\x9d", "plain"
+    };
+    QByteArray out;
+    while (out.size() < size)
+    {
+        int width = 0;
+        while (width < BENCH_COLUMNS - 8)
+        {
+            out += samples[pick(rng, sizeof(samples) / sizeof(samples[0]))];
+            out += ' ';
+            width += 6;
+        }
+        out += "\r\n";
+    }
+    return out;
+}
+
+QByteArray colourHeavy(Rng & rng, int size)
+{
+    QByteArray out;
+    while (out.size() < size)
+    {
+        for (int column = 0; column < BENCH_COLUMNS; ++column)
+        {
+            if (pick(rng, 2))
+                out += "\x1b[38;5;" + QByteArray::number(pick(rng, 256)) + ";48;5;"
+                       + QByteArray::number(pick(rng, 256)) + 'm';
+            else
+                out += "\x1b[38;2;" + QByteArray::number(pick(rng, 256)) + ';'
+                       + QByteArray::number(pick(rng, 256)) + ';' + QByteArray::number(pick(rng, 256)) + 'm';
+            out += char('!' + pick(rng, 94));
+        }
+        out += "\x1b[m\r\n";
+    }
+    return out;
+}
+
+QList<Stream> generatedCorpus(int size)
+{
+    typedef QByteArray (*Generator)(Rng &, int);
+    static const struct { const char * name; Generator generate; } generators[] = {
+        { "ls -lR", lsRecursive },
+        { "compiler", compilerLog },
+        { "vim", vimScrolling },
+        { "htop", htop },
+        { "unicode", unicodeHeavy },
+        { "colour", colourHeavy }
+    };
+
+    QList<Stream> corpus;
+    for (const auto & g : generators)
+    {
+        Rng rng(42);
+        corpus.append(Stream{ g.name, g.generate(rng, size) });
+    }
+    return corpus;
+}
+
+
+/*! \brief Measures the paint events of the widgets it is installed on.
+*/
+class PaintTimer : public QObject
+{
+    public:
+        QVector<qint64> frames;
+
+    protected:
+        bool eventFilter(QObject * watched, QEvent * event)
+        {
+            if (event->type() != QEvent::Paint)
+                return false;
+            QElapsedTimer clock;
+            clock.start();
+            watched->event(event);
+            frames.append(clock.nsecsElapsed());
+            return true;
+        }
+};
+
+Result replay(const QByteArray & data)
+{
+    Result result;
+    result.bytes = data.size();
+    result.lines = data.count('\n');
+
+    TermWidgetImpl term(QString(), QString(), 0, TermWidgetImpl::TeletypeMode);
+    term.setSize(QSize(BENCH_COLUMNS, BENCH_LINES));
+    term.show();
+    term.startTerminalTeletype();
+
+    // raw mode, the streams carry their own carriage returns
+    int fd = term.getPtySlaveFd();
+    struct termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    // only the character grid, not the scroll bar or search bar
+    PaintTimer paints;
+    foreach (QWidget * child, term.findChildren<QWidget*>())
+    {
+        if (QByteArray(child->metaObject()->className()).endsWith("TerminalDisplay"))
+            child->installEventFilter(&paints);
+    }
+
+    qint64 received = 0;
+    QObject::connect(&term, &QTermWidget::receivedData,
+                     [&received](const QString & text) { received += text.size(); });
+
+    QElapsedTimer clock;
+    clock.start();
+    qint64 written = 0;
+    while (received < data.size())
+    {
+        if (written < data.size())
+        {
+            ssize_t n = ::write(fd, data.constData() + written, data.size() - written);
+            if (n > 0)
+            {
+                written += n;
+                continue;
+            }
+            if (n < 0 && errno != EAGAIN && errno != EINTR)
+            {
+                perror("write");
+                break;
+            }
+        }
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+    result.nsecs = clock.nsecsElapsed();
+
+    QEventLoop settle;
+    QTimer::singleShot(SETTLE_MS, &settle, SLOT(quit()));
+    settle.exec();
+
+    result.frames = paints.frames;
+    std::sort(result.frames.begin(), result.frames.end());
+    return result;
+}
+
+double percentileMs(const QVector<qint64> & sorted, double p)
+{
+    if (sorted.isEmpty())
+        return 0;
+    return sorted.at(qMin(sorted.count() - 1, int(p * sorted.count()))) / 1e6;
+}
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+    int size = 8;
+    int frameRate = -1;
+    int next_option;
+    do {
+        next_option = getopt_long(argc, argv, short_options, long_options, NULL);
+        switch (next_option)
+        {
+            case 'h':
+                print_usage_and_exit(0);
+            case 's':
+                size = qMax(1, atoi(optarg));
+                break;
+            case 'f':
+                frameRate = qMax(0, atoi(optarg));
+                break;
+            case '?':
+                print_usage_and_exit(1);
+        }
+    }
+    while (next_option != -1);
+
+    // no display needed, and no window manager timing in the numbers
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    // defaults only, the user's settings must not change the results
+    QTemporaryDir config;
+    Properties::Instance(config.path() + "/bench.conf")->loadSettings();
+    if (frameRate >= 0)
+        Properties::Instance()->frameRate = frameRate;
+    // the replayed terminal may not get the focus offscreen
+    Properties::Instance()->backgroundFrameRate = Properties::Instance()->frameRate;
+
+    QList<Stream> streams;
+    for (int i = optind; i < argc; ++i)
+    {
+        QFile file(QString::fromLocal8Bit(argv[i]));
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            fprintf(stderr, "Cannot read %s\n", argv[i]);
+            return 1;
+        }
+        streams.append(Stream{ QFileInfo(file).fileName().toLocal8Bit(), file.readAll() });
+    }
+    if (streams.isEmpty())
+        streams = generatedCorpus(size << 20);
+
+    printf("%-16s %10s %12s %8s %8s %8s\n", "stream", "MB/s", "lines/s", "frames", "p50 ms", "p99 ms");
+    foreach (const Stream & stream, streams)
+    {
+        Result r = replay(stream.data);
+        double secs = r.nsecs / 1e9;
+        printf("%-16s %10.2f %12.0f %8d %8.2f %8.2f\n", stream.name.constData(),
+               r.bytes / 1e6 / secs, r.lines / secs, r.frames.count(),
+               percentileMs(r.frames, 0.5), percentileMs(r.frames, 0.99));
+        fflush(stdout);
+    }
+
+    delete Properties::Instance();
+    return 0;
+}
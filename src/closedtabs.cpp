@@ -0,0 +1,170 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QRunnable>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+
+#include "closedtabs.h"
+#include "tabwidget.h"
+#include "termwidgetholder.h"
+#include "termhistory.h"
+#include "historydir.h"
+#include "properties.h"
+
+// ids are shared by the tabs of all windows, they name the history files
+static int ClosedTabCount = 0;
+
+
+namespace {
+
+class SaveTabTask : public QRunnable
+{
+    public:
+        SaveTabTask(QObject * owner, int id, const QStringList & files, const QList<TermHistorySnapshot> & histories)
+            : m_owner(owner),
+              m_id(id),
+              m_files(files),
+              m_histories(histories)
+        {
+        }
+
+        void run()
+        {
+            qlonglong bytes = 0;
+            for (int i = 0; i < m_files.count(); ++i)
+            {
+                TermHistory::save(m_histories.at(i), m_files.at(i));
+                bytes += QFileInfo(m_files.at(i)).size();
+            }
+            QMetaObject::invokeMethod(m_owner, "saved", Qt::QueuedConnection,
+                                      Q_ARG(int, m_id), Q_ARG(qlonglong, bytes));
+        }
+
+    private:
+        QObject * m_owner;
+        int m_id;
+        QStringList m_files;
+        QList<TermHistorySnapshot> m_histories;
+};
+
+}
+
+
+ClosedTabs::ClosedTabs(TabWidget * tabs)
+    : QObject(tabs),
+      m_tabWidget(tabs)
+{
+    // one at a time, a tab is usually closed long after the previous one
+    m_pool.setMaxThreadCount(1);
+}
+
+ClosedTabs::~ClosedTabs()
+{
+    m_pool.waitForDone();
+    foreach (const Tab & tab, m_closed)
+        drop(tab);
+}
+
+void ClosedTabs::add(TermWidgetHolder * holder, const QString & customName)
+{
+    if (!holder || Properties::Instance()->closedTabsCount <= 0)
+        return;
+
+    if (m_dir.isEmpty())
+    {
+        QString dir = HistoryDir::path();
+        if (dir.isEmpty() || !QDir(dir).mkpath("closed"))
+            return;
+        m_dir = dir + "/closed";
+    }
+
+    QList<TermWidget*> terms;
+    Tab tab;
+    tab.layout = TabLayout::capture(holder, customName, terms);
+    if (tab.layout.isEmpty())
+        return;
+    tab.id = ++ClosedTabCount;
+    // still being saved
+    tab.bytes = -1;
+
+    QList<TermHistorySnapshot> histories;
+    for (int pane = 0; pane < terms.count(); ++pane)
+    {
+        tab.files.append(QString("%1/%2-%3.qth").arg(m_dir).arg(tab.id).arg(pane));
+        histories.append(terms.at(pane)->impl()->history()->snapshot());
+    }
+    m_pool.start(new SaveTabTask(this, tab.id, tab.files, histories));
+
+    m_closed.append(tab);
+    enforceLimits();
+    emit changed();
+}
+
+int ClosedTabs::reopen()
+{
+    if (m_closed.isEmpty())
+        return -1;
+
+    Tab tab = m_closed.takeLast();
+    // closed a moment ago, the histories are still being written
+    if (tab.bytes < 0)
+        m_pool.waitForDone();
+
+    int ix = tab.layout.restore(m_tabWidget, tab.files);
+
+    // the terminals have loaded their histories by now
+    drop(tab);
+    emit changed();
+    return ix;
+}
+
+void ClosedTabs::saved(int id, qlonglong bytes)
+{
+    for (int i = 0; i < m_closed.count(); ++i)
+    {
+        if (m_closed.at(i).id == id)
+            m_closed[i].bytes = bytes;
+    }
+    enforceLimits();
+}
+
+void ClosedTabs::enforceLimits()
+{
+    qint64 budget = qint64(Properties::Instance()->closedTabsSize) * 1024 * 1024;
+    qint64 total = 0;
+    foreach (const Tab & tab, m_closed)
+        total += qMax<qint64>(0, tab.bytes);
+
+    while (!m_closed.isEmpty() && (m_closed.count() > Properties::Instance()->closedTabsCount || total > budget))
+    {
+        Tab tab = m_closed.takeFirst();
+        total -= qMax<qint64>(0, tab.bytes);
+        drop(tab);
+    }
+}
+
+void ClosedTabs::drop(const Tab & tab)
+{
+    // a file still being saved would come back after its removal
+    if (tab.bytes < 0)
+        m_pool.waitForDone();
+    foreach (const QString & file, tab.files)
+        QFile::remove(file);
+}
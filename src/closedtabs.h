@@ -0,0 +1,82 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef CLOSEDTABS_H
+#define CLOSEDTABS_H
+
+#include <QObject>
+#include <QList>
+#include <QStringList>
+#include <QThreadPool>
+
+#include "tablayout.h"
+
+class TabWidget;
+class TermWidgetHolder;
+
+
+/*! \brief Recently closed tabs of a TabWidget, for reopening them.
+
+A closed tab is remembered with its TabLayout (the splits, the working
+directories and the custom name) and the history of each terminal. The histories are
+written to the private HistoryDir on a background thread, so closing a
+tab is as quick as ever. The cache is limited by the number of tabs and
+by the size of the history files, the oldest tabs are forgotten first.
+
+Reopening starts fresh shells in the old directories, the histories are
+loaded by the new terminals.
+*/
+class ClosedTabs : public QObject
+{
+    Q_OBJECT
+
+    public:
+        explicit ClosedTabs(TabWidget * tabs);
+        ~ClosedTabs();
+
+        bool isEmpty() const { return m_closed.isEmpty(); }
+        //! Remember \a holder, which is about to be deleted
+        void add(TermWidgetHolder * holder, const QString & customName);
+        //! Recreate the most recently closed tab, returns its index or -1
+        int reopen();
+
+    signals:
+        void changed();
+
+    private slots:
+        void saved(int id, qlonglong bytes);
+
+    private:
+        struct Tab
+        {
+            int id;
+            TabLayout layout;
+            QStringList files;
+            qint64 bytes;
+        };
+
+        void drop(const Tab & tab);
+        void enforceLimits();
+
+        TabWidget * m_tabWidget;
+        QList<Tab> m_closed;
+        QThreadPool m_pool;
+        QString m_dir;
+};
+
+#endif
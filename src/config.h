@@ -23,6 +23,7 @@
 #define ADD_TAB "Add Tab"
 #define RENAME_TAB "Rename Tab"
 #define CLOSE_TAB "Close Tab"
+#define REOPEN_TAB "Reopen Closed Tab"
 #define NEW_WINDOW "New Window"
 
 #define QUIT "Quit"
@@ -52,6 +53,17 @@
 #define ZOOM_RESET "Zoom reset"
 
 #define FIND "Find"
+#define FIND_ALL "Find in All Terminals"
+#define FILTER_VIEW "Filter View"
+#define SCREEN_HISTORY "Screen History"
+#define EXPORT_HISTORY "Export History"
+#define PREVIOUS_PROMPT "Previous Prompt"
+#define NEXT_PROMPT "Next Prompt"
+#define SELECT_OUTPUT "Select Command Output"
+#define COPY_OUTPUT "Copy Last Output"
+#define COMMAND_DURATION "Command Duration"
+#define LATENCY_REPORT "Latency Report"
+#define LATENCY_TEST "Echo Latency Test"
 
 #define TOGGLE_MENU "Toggle Menu"
 #define TOGGLE_BOOKMARKS "Toggle Bookmarks"
@@ -60,6 +72,8 @@
 #define SHOW_TAB_BAR "Show Tab Bar"
 #define RENAME_SESSION "Rename Session"
 #define FULLSCREEN "Fullscreen"
+#define SHOW_TIMESTAMPS "Show Timestamps"
+#define SHOW_LATENCY "Show Latency Overlay"
 
 /* Some defaults for QTerminal application */
 
@@ -107,6 +121,9 @@
 
 #define FULLSCREEN_SHORTCUT           "F11"
 
+#define PREVIOUS_PROMPT_SHORTCUT       "Ctrl+Shift+Up"
+#define NEXT_PROMPT_SHORTCUT           "Ctrl+Shift+Down"
+
 // XON/XOFF features:
 
 #define FLOW_CONTROL_ENABLED		false
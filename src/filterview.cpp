@@ -0,0 +1,312 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QLineEdit>
+#include <QLabel>
+#include <QListView>
+#include <QToolButton>
+#include <QScrollBar>
+#include <QBoxLayout>
+
+#include "filterview.h"
+#include "termwidget.h"
+#include "termhistory.h"
+
+// the view takes matches in batches at most this often
+#define FLUSH_INTERVAL_MS 50
+
+
+static bool isLiteral(const QString & pattern)
+{
+    static const QString special("\\^$.|?*+()[]{}");
+    foreach (QChar c, pattern)
+    {
+        if (special.contains(c))
+            return false;
+    }
+    return true;
+}
+
+
+FilterMatcher::FilterMatcher(const QAtomicInt * wanted)
+    : m_wanted(wanted),
+      m_generation(-1),
+      m_literal(false),
+      m_ignoreCase(false)
+{
+}
+
+void FilterMatcher::start(int generation, const QString & pattern, const TermHistorySnapshot & history)
+{
+    m_generation = generation;
+    m_ignoreCase = pattern == pattern.toLower();
+    m_literal = isLiteral(pattern);
+    if (m_literal)
+    {
+        QByteArray bytes = pattern.toUtf8();
+        m_matcher.setPattern(m_ignoreCase ? bytes.toLower() : bytes);
+    }
+    else
+    {
+        m_regexp = QRegularExpression(pattern, m_ignoreCase ? QRegularExpression::CaseInsensitiveOption
+                                                            : QRegularExpression::NoPatternOption);
+        m_regexp.optimize();
+    }
+
+    for (int block = 0; block < history.blockCount() && m_wanted->load() == generation; ++block)
+    {
+        QList<SearchHit> hits;
+        match(history.blockFirstLine(block), history.blockLines(block), hits);
+        if (!hits.isEmpty())
+            emit matched(generation, hits);
+    }
+}
+
+void FilterMatcher::addLines(int generation, qlonglong first, const QList<QByteArray> & lines)
+{
+    if (generation != m_generation || m_wanted->load() != generation)
+        return;
+
+    QList<SearchHit> hits;
+    match(first, lines, hits);
+    if (!hits.isEmpty())
+        emit matched(generation, hits);
+}
+
+void FilterMatcher::match(qint64 first, const QList<QByteArray> & lines, QList<SearchHit> & hits) const
+{
+    for (int i = 0; i < lines.count(); ++i)
+    {
+        QByteArray line = TermHistory::stripAttributes(lines.at(i));
+        bool found;
+        if (m_literal)
+            found = m_matcher.indexIn(m_ignoreCase ? line.toLower() : line) >= 0;
+        else
+            found = m_regexp.match(QString::fromUtf8(line)).hasMatch();
+        if (!found)
+            continue;
+
+        SearchHit hit;
+        hit.terminal = 0;
+        hit.line = first + i;
+        hit.time = 0;
+        hit.text = line;
+        hit.score = 1;
+        hits.append(hit);
+    }
+}
+
+
+int FilterModel::rowCount(const QModelIndex & parent) const
+{
+    return parent.isValid() ? 0 : m_hits.count();
+}
+
+QVariant FilterModel::data(const QModelIndex & index, int role) const
+{
+    if (role != Qt::DisplayRole || index.row() >= m_hits.count())
+        return QVariant();
+    return QString::fromUtf8(m_hits.at(index.row()).text);
+}
+
+void FilterModel::append(const QList<SearchHit> & hits)
+{
+    if (hits.isEmpty())
+        return;
+
+    beginInsertRows(QModelIndex(), m_hits.count(), m_hits.count() + hits.count() - 1);
+    foreach (const SearchHit & hit, hits)
+        m_hits.append(hit);
+    endInsertRows();
+
+    // drop the oldest matches in chunks, removing rows moves the whole vector
+    if (m_hits.count() > MaxLines + MaxLines / 4)
+    {
+        int excess = m_hits.count() - MaxLines;
+        beginRemoveRows(QModelIndex(), 0, excess - 1);
+        m_hits.remove(0, excess);
+        endRemoveRows();
+    }
+}
+
+void FilterModel::clear()
+{
+    beginResetModel();
+    m_hits.clear();
+    endResetModel();
+}
+
+
+FilterView::FilterView(TermWidgetImpl * term, QWidget * parent)
+    : QWidget(parent),
+      m_term(term),
+      m_found(0),
+      m_generation(0),
+      m_running(false)
+{
+    // make sure the metatypes used with the matcher are registered
+    SearchIndex::Instance();
+
+    m_patternEdit = new QLineEdit(this);
+    m_patternEdit->setPlaceholderText(tr("Show lines matching..."));
+    m_patternEdit->setClearButtonEnabled(true);
+    m_statusLabel = new QLabel(this);
+    QToolButton * closeButton = new QToolButton(this);
+    closeButton->setIcon(QIcon::fromTheme("window-close"));
+    closeButton->setAutoRaise(true);
+    closeButton->setToolTip(tr("Close the filter view"));
+
+    m_listView = new QListView(this);
+    m_listView->setModel(&m_model);
+    m_listView->setUniformItemSizes(true);
+    m_listView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    QHBoxLayout * bar = new QHBoxLayout;
+    bar->addWidget(m_patternEdit);
+    bar->addWidget(m_statusLabel);
+    bar->addWidget(closeButton);
+    QVBoxLayout * layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->setSpacing(0);
+    layout->addLayout(bar);
+    layout->addWidget(m_listView);
+
+    m_editTimer.setSingleShot(true);
+    m_editTimer.setInterval(150);
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FLUSH_INTERVAL_MS);
+
+    m_matcher = new FilterMatcher(&m_generation);
+    m_matcher->moveToThread(&m_thread);
+    m_thread.setObjectName("FilterView");
+    m_thread.start(QThread::LowPriority);
+
+    connect(m_patternEdit, SIGNAL(textChanged(QString)), &m_editTimer, SLOT(start()));
+    connect(m_patternEdit, SIGNAL(returnPressed()), this, SLOT(restart()));
+    connect(&m_editTimer, SIGNAL(timeout()), this, SLOT(restart()));
+    connect(&m_flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+    connect(closeButton, SIGNAL(clicked()), this, SLOT(hide()));
+    connect(m_listView, SIGNAL(activated(QModelIndex)), this, SLOT(activate(QModelIndex)));
+    connect(m_matcher, SIGNAL(matched(int,QList<SearchHit>)), this, SLOT(matched(int,QList<SearchHit>)));
+}
+
+FilterView::~FilterView()
+{
+    m_generation.ref();
+    m_thread.quit();
+    m_thread.wait();
+    delete m_matcher;
+}
+
+void FilterView::showEvent(QShowEvent * event)
+{
+    m_listView->setFont(m_term->getTerminalFont());
+    m_patternEdit->setFocus();
+    restart();
+    QWidget::showEvent(event);
+}
+
+void FilterView::hideEvent(QHideEvent * event)
+{
+    // nothing is matched while nobody can see it, showing rescans the history
+    stop();
+    QWidget::hideEvent(event);
+}
+
+void FilterView::stop()
+{
+    m_generation.ref();
+    if (m_running)
+        disconnect(m_term->history(), SIGNAL(linesAdded(qint64,int)), this, SLOT(addLines(qint64,int)));
+    m_running = false;
+    m_editTimer.stop();
+    m_flushTimer.stop();
+    m_pending.clear();
+    m_found = 0;
+    m_model.clear();
+    m_statusLabel->clear();
+}
+
+void FilterView::restart()
+{
+    stop();
+
+    QString pattern = m_patternEdit->text();
+    if (pattern.isEmpty() || !isVisible())
+        return;
+    if (!isLiteral(pattern))
+    {
+        QRegularExpression regexp(pattern);
+        if (!regexp.isValid())
+        {
+            m_statusLabel->setText(regexp.errorString());
+            return;
+        }
+    }
+
+    // lines added from now on are not in the snapshot
+    connect(m_term->history(), SIGNAL(linesAdded(qint64,int)), this, SLOT(addLines(qint64,int)));
+    m_running = true;
+    QMetaObject::invokeMethod(m_matcher, "start", Qt::QueuedConnection,
+                              Q_ARG(int, m_generation.load()),
+                              Q_ARG(QString, pattern),
+                              Q_ARG(TermHistorySnapshot, m_term->history()->snapshot()));
+    m_statusLabel->setText(tr("No matching lines"));
+}
+
+void FilterView::addLines(qint64 first, int count)
+{
+    TermHistory * history = m_term->history();
+    qint64 from = qMax(first, history->firstLine());
+    QList<QByteArray> lines;
+    for (qint64 n = from; n < first + count; ++n)
+        lines.append(history->line(n));
+    QMetaObject::invokeMethod(m_matcher, "addLines", Qt::QueuedConnection,
+                              Q_ARG(int, m_generation.load()),
+                              Q_ARG(qlonglong, from),
+                              Q_ARG(QList<QByteArray>, lines));
+}
+
+void FilterView::matched(int generation, const QList<SearchHit> & hits)
+{
+    if (generation != m_generation.load())
+        return;
+
+    m_pending += hits;
+    m_found += hits.count();
+    if (!m_flushTimer.isActive())
+        m_flushTimer.start();
+}
+
+void FilterView::flush()
+{
+    QScrollBar * scrollBar = m_listView->verticalScrollBar();
+    bool follow = scrollBar->value() == scrollBar->maximum();
+
+    m_model.append(m_pending);
+    m_pending.clear();
+    m_statusLabel->setText(tr("%n matching line(s)", "", m_found));
+
+    if (follow)
+        m_listView->scrollToBottom();
+}
+
+void FilterView::activate(const QModelIndex & index)
+{
+    m_term->scrollToHistoryLine(m_model.line(index.row()));
+}
@@ -0,0 +1,139 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef FILTERVIEW_H
+#define FILTERVIEW_H
+
+#include <QWidget>
+#include <QThread>
+#include <QTimer>
+#include <QAtomicInt>
+#include <QByteArrayMatcher>
+#include <QRegularExpression>
+#include <QAbstractListModel>
+#include <QVector>
+
+#include "searchindex.h"
+
+class QLineEdit;
+class QLabel;
+class QListView;
+class TermWidgetImpl;
+
+
+/*! \brief Matches history lines against the pattern of a FilterView.
+
+Lives on the thread of its view. The history present when the pattern is
+set is scanned once, after that every new line is matched as it arrives,
+so each line is looked at exactly once. Patterns without special
+characters are matched as plain bytes, which is a lot faster than the
+regular expression engine. A pattern without capitals ignores case.
+*/
+class FilterMatcher : public QObject
+{
+    Q_OBJECT
+
+    public:
+        //! The matcher stops working on a generation once \a wanted moves on
+        explicit FilterMatcher(const QAtomicInt * wanted);
+
+    public slots:
+        void start(int generation, const QString & pattern, const TermHistorySnapshot & history);
+        void addLines(int generation, qlonglong first, const QList<QByteArray> & lines);
+
+    signals:
+        void matched(int generation, const QList<SearchHit> & hits);
+
+    private:
+        void match(qint64 first, const QList<QByteArray> & lines, QList<SearchHit> & hits) const;
+
+        const QAtomicInt * m_wanted;
+        int m_generation;
+        bool m_literal;
+        bool m_ignoreCase;
+        QByteArrayMatcher m_matcher;
+        QRegularExpression m_regexp;
+};
+
+
+//! Matching lines shown by a FilterView, oldest first
+class FilterModel : public QAbstractListModel
+{
+    public:
+        enum { MaxLines = 100000 };
+
+        explicit FilterModel(QObject * parent = 0) : QAbstractListModel(parent) {}
+
+        int rowCount(const QModelIndex & parent = QModelIndex()) const;
+        QVariant data(const QModelIndex & index, int role = Qt::DisplayRole) const;
+
+        qint64 line(int row) const { return m_hits.at(row).line; }
+        void append(const QList<SearchHit> & hits);
+        void clear();
+
+    private:
+        QVector<SearchHit> m_hits;
+};
+
+
+/*! \brief Live "grep" of one terminal.
+
+Shows the lines of the history matching a pattern and keeps adding new
+ones as the terminal prints them. The matching runs on a thread of its own
+and the results are added to the list in batches, so a flood of output
+slows neither the terminal nor the list. Activating a line scrolls the
+terminal to it.
+*/
+class FilterView : public QWidget
+{
+    Q_OBJECT
+
+    public:
+        explicit FilterView(TermWidgetImpl * term, QWidget * parent = 0);
+        ~FilterView();
+
+    protected:
+        void showEvent(QShowEvent * event);
+        void hideEvent(QHideEvent * event);
+
+    private slots:
+        void restart();
+        void addLines(qint64 first, int count);
+        void matched(int generation, const QList<SearchHit> & hits);
+        void flush();
+        void activate(const QModelIndex & index);
+
+    private:
+        void stop();
+
+        TermWidgetImpl * m_term;
+        QLineEdit * m_patternEdit;
+        QLabel * m_statusLabel;
+        QListView * m_listView;
+        FilterModel m_model;
+        QList<SearchHit> m_pending;
+        int m_found;
+        QTimer m_editTimer;
+        QTimer m_flushTimer;
+        QThread m_thread;
+        FilterMatcher * m_matcher;
+        QAtomicInt m_generation;
+        bool m_running;
+};
+
+#endif
@@ -0,0 +1,184 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QApplication>
+#include <QFontMetrics>
+#include <QImage>
+#include <QPainter>
+#include <QTimer>
+
+#include "fontregistry.h"
+#include "memorypressure.h"
+
+
+FontRegistry * FontRegistry::m_instance = 0;
+
+// zoom sizes nobody uses any longer that are kept around
+#define MAX_UNUSED_FONTS 8
+// TerminalDisplay::decreaseTextSize() doesn't go below this
+#define MIN_ZOOM_POINT_SIZE 6.0
+// pre-warm once no terminal has printed anything for this long
+#define PREWARM_IDLE_MS 2000
+
+// what a terminal shows most, rasterised ahead of the first zoom step
+static QString prewarmText()
+{
+    QString text;
+    for (ushort c = 0x20; c < 0x7f; ++c)
+        text += QChar(c);
+    // box drawing and block elements of full screen programs
+    for (ushort c = 0x2500; c < 0x25a0; ++c)
+        text += QChar(c);
+    return text;
+}
+
+
+FontRegistry * FontRegistry::Instance()
+{
+    if (!m_instance)
+    {
+        m_instance = new FontRegistry(qApp);
+        connect(MemoryPressureMonitor::Instance(), SIGNAL(memoryPressure()),
+                m_instance, SLOT(dropUnused()));
+    }
+    return m_instance;
+}
+
+FontRegistry::FontRegistry(QObject * parent)
+    : QObject(parent)
+{
+    m_prewarmTimer.setSingleShot(true);
+    m_prewarmTimer.setTimerType(Qt::VeryCoarseTimer);
+    m_prewarmTimer.setInterval(PREWARM_IDLE_MS);
+    connect(&m_prewarmTimer, SIGNAL(timeout()), this, SLOT(prewarmPending()));
+}
+
+FontRegistry::~FontRegistry()
+{
+    m_instance = 0;
+}
+
+FontRegistry::Entry & FontRegistry::entry(const QFont & font)
+{
+    QHash<QString, Entry>::iterator it = m_fonts.find(font.key());
+    if (it == m_fonts.end())
+    {
+        Entry e = { font, 0 };
+        it = m_fonts.insert(font.key(), e);
+    }
+    return it.value();
+}
+
+QFont FontRegistry::acquire(const QFont & requested, bool prewarmZoom)
+{
+    // as TerminalDisplay::setVTFont() does
+    QFont font = requested;
+    font.setKerning(false);
+    font.setStyleStrategy(QFont::StyleStrategy(font.styleStrategy() | QFont::ForceIntegerMetrics));
+
+    Entry & e = entry(font);
+    ++e.refs;
+    QFont shared = e.font;
+
+    if (prewarmZoom)
+    {
+        foreach (const QFont & zoomed, zoomSteps(shared))
+        {
+            if (!m_fonts.contains(zoomed.key()))
+                schedulePrewarm(entry(zoomed).font);
+        }
+    }
+    return shared;
+}
+
+QList<QFont> FontRegistry::zoomSteps(const QFont & font)
+{
+    // pixel sized fonts are not zoomed in points
+    QList<QFont> steps;
+    if (font.pointSizeF() <= 1)
+        return steps;
+
+    // the steps of QTermWidget::zoomIn() and zoomOut(), in fractional
+    // points like they are so the keys match for 10.5pt fonts as well
+    QFont smaller = font;
+    smaller.setPointSizeF(qMax(font.pointSizeF() - 1, MIN_ZOOM_POINT_SIZE));
+    QFont larger = font;
+    larger.setPointSizeF(font.pointSizeF() + 1);
+    steps << smaller << larger;
+    return steps;
+}
+
+QSet<QString> FontRegistry::droppable() const
+{
+    QSet<QString> keys;
+    foreach (const Entry & e, m_fonts)
+    {
+        if (e.refs <= 0)
+            keys.insert(e.font.key());
+    }
+    foreach (const Entry & e, m_fonts)
+    {
+        if (e.refs <= 0)
+            continue;
+        foreach (const QFont & zoomed, zoomSteps(e.font))
+            keys.remove(zoomed.key());
+    }
+    return keys;
+}
+
+void FontRegistry::release(const QFont & font)
+{
+    QHash<QString, Entry>::iterator it = m_fonts.find(font.key());
+    if (it == m_fonts.end() || --it.value().refs > 0)
+        return;
+
+    // kept for zooming back, up to a point
+    if (droppable().count() > MAX_UNUSED_FONTS)
+        dropUnused();
+}
+
+void FontRegistry::schedulePrewarm(const QFont & font)
+{
+    m_pending.append(font);
+    m_prewarmTimer.start();
+}
+
+void FontRegistry::prewarmPending()
+{
+    static const QString text = prewarmText();
+
+    foreach (const QFont & font, m_pending)
+    {
+        // dropped again in the meantime
+        if (!m_fonts.contains(font.key()))
+            continue;
+        // opaque like the terminal, which decides the glyph format cached
+        QFontMetrics metrics(font);
+        QImage image(metrics.width(text), metrics.height(), QImage::Format_RGB32);
+        QPainter p(&image);
+        p.setFont(font);
+        p.drawText(0, metrics.ascent(), text);
+    }
+    m_pending.clear();
+}
+
+void FontRegistry::dropUnused()
+{
+    foreach (const QString & key, droppable())
+        m_fonts.remove(key);
+}
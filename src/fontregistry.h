@@ -0,0 +1,95 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef FONTREGISTRY_H
+#define FONTREGISTRY_H
+
+#include <QFont>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+
+
+/*! \brief Process wide, reference counted set of terminal fonts.
+
+qtermwidget draws text with QPainter, so glyphs are rasterised and cached
+by Qt's font engines. Terminals only share those engines, and with them
+the cached glyphs, when their fonts resolve alike. Every terminal takes its
+font from here, so all terminals using the same family, size and style
+draw from one QFont and one engine, which stays alive while any terminal
+uses it.
+
+With pre-warming the sizes one zoom step up and down are loaded and their
+printable glyphs rasterised once the terminals have been quiet for a while,
+so zooming does not start from an empty cache and the work doesn't compete
+with the first frames of a new terminal. The sizes one step away from a
+font in use stay; other sizes nobody uses are dropped on memory pressure.
+*/
+class FontRegistry : public QObject
+{
+    Q_OBJECT
+
+    public:
+        static FontRegistry * Instance();
+        static bool isRunning() { return m_instance; }
+        ~FontRegistry();
+
+        /*! The shared font equal to \a font, release() it when done. It is
+            adjusted the way TerminalDisplay adjusts its font, so that both
+            resolve to the same font engine.
+         */
+        QFont acquire(const QFont & font, bool prewarmZoom = false);
+        void release(const QFont & font);
+        //! A terminal got output, pre-warming waits until it has been idle
+        void outputReceived()
+        {
+            if (!m_pending.isEmpty())
+                m_prewarmTimer.start();
+        }
+
+    private slots:
+        void prewarmPending();
+        void dropUnused();
+
+    private:
+        explicit FontRegistry(QObject * parent = 0);
+
+        struct Entry
+        {
+            QFont font;
+            int refs;
+        };
+
+        Entry & entry(const QFont & font);
+        void schedulePrewarm(const QFont & font);
+        //! The sizes one zoom step down and up from \a font
+        static QList<QFont> zoomSteps(const QFont & font);
+        //! Unused fonts that are not a zoom step of one in use
+        QSet<QString> droppable() const;
+
+        static FontRegistry * m_instance;
+
+        // by QFont::key(), i.e. family, size and style
+        QHash<QString, Entry> m_fonts;
+        QList<QFont> m_pending;
+        QTimer m_prewarmTimer;
+};
+
+#endif
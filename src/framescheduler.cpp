@@ -0,0 +1,243 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QWidget>
+
+#include <string.h>
+
+#include "framescheduler.h"
+
+// more than this within one frame is a flood, not interactive output
+#define FLOOD_BYTES 4096
+// longest a synchronized update may hold the painting
+#define SYNC_TIMEOUT_MS 150
+// longer control sequences are of no interest, they are skipped
+#define MAX_CSI_LENGTH 32
+
+
+FrameScheduler::FrameScheduler(QWidget * widget)
+    : QObject(widget),
+      m_widget(widget),
+      m_display(0),
+      m_focusedFps(60),
+      m_backgroundFps(60),
+      m_throttledFps(60),
+      m_focused(false),
+      m_throttled(false),
+      m_bytes(0),
+      m_held(false),
+      m_synchronized(false),
+      m_syncExpired(false),
+      m_requested(false),
+      m_scanState(Ground)
+{
+    foreach (QWidget * child, widget->findChildren<QWidget*>())
+    {
+        if (QByteArray(child->metaObject()->className()).endsWith("TerminalDisplay"))
+            m_display = child;
+    }
+
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(frame()));
+    applyFrameRate();
+
+    m_syncTimer.setSingleShot(true);
+    m_syncTimer.setInterval(SYNC_TIMEOUT_MS);
+    connect(&m_syncTimer, SIGNAL(timeout()), this, SLOT(synchronizeTimeout()));
+}
+
+void FrameScheduler::setFrameRates(int focused, int background, int throttled)
+{
+    m_focusedFps = focused;
+    m_backgroundFps = background;
+    m_throttledFps = throttled;
+    applyFrameRate();
+}
+
+void FrameScheduler::setFocused(bool focused)
+{
+    m_focused = focused;
+    applyFrameRate();
+}
+
+void FrameScheduler::setThrottled(bool throttled)
+{
+    m_throttled = throttled;
+    applyFrameRate();
+}
+
+void FrameScheduler::applyFrameRate()
+{
+    int fps = m_throttled ? m_throttledFps : m_focused ? m_focusedFps : m_backgroundFps;
+    if (fps <= 0)
+    {
+        m_timer.stop();
+        hold(m_synchronized);
+        m_timer.setInterval(0);
+        return;
+    }
+    m_timer.setInterval(qMax(1, 1000 / fps));
+}
+
+void FrameScheduler::dataReceived(const QByteArray & data)
+{
+    // The display copies the screen on a timer, so holding the painting
+    // here, still within the read of the chunk, comes before any paint of it.
+    if (scan(data))
+        m_syncExpired = false;
+    setSynchronized(m_requested);
+
+    if (m_timer.interval() <= 0)
+        return;
+
+    m_bytes += data.size();
+    if (!m_timer.isActive())
+        m_timer.start();
+    if (m_bytes >= FLOOD_BYTES)
+        hold(true);
+}
+
+bool FrameScheduler::scan(const QByteArray & data)
+{
+    bool closed = false;
+    const char * p = data.constData();
+    const char * end = p + data.size();
+    while (p < end)
+    {
+        if (m_scanState == Ground)
+        {
+            p = static_cast<const char*>(memchr(p, '\x1b', end - p));
+            if (!p)
+                break;
+            m_scanState = Escape;
+            ++p;
+            continue;
+        }
+
+        char c = *p++;
+        if (c == '\x1b')
+            m_scanState = Escape;
+        else if (m_scanState == Escape)
+        {
+            m_scanState = c == '[' ? Csi : Ground;
+            m_seq.clear();
+        }
+        else if (c >= 0x40 && c <= 0x7e)
+        {
+            m_seq.append(c);
+            handleCsi(closed);
+            m_scanState = Ground;
+        }
+        else if (c >= 0x20)
+        {
+            m_seq.append(c);
+            if (m_seq.size() > MAX_CSI_LENGTH)
+                m_scanState = Ground;
+        }
+        // other control characters are executed within the sequence
+    }
+    return closed;
+}
+
+void FrameScheduler::handleCsi(bool & closed)
+{
+    char final = m_seq.at(m_seq.size() - 1);
+    if (!m_seq.startsWith('?'))
+        return;
+
+    if (final == 'h' || final == 'l')
+    {
+        foreach (const QByteArray & mode, m_seq.mid(1, m_seq.size() - 2).split(';'))
+        {
+            if (mode.toInt() == 2026)
+            {
+                m_requested = final == 'h';
+                closed = closed || !m_requested;
+            }
+        }
+    }
+    else if (m_seq == "?2026$p")
+    {
+        // the emulation does not answer DECRQM, programs probe for 2026 with it
+        emit modeQueried(2026, m_requested);
+    }
+}
+
+void FrameScheduler::frame()
+{
+    bool flood = m_bytes >= FLOOD_BYTES;
+    if (m_held && !m_synchronized)
+    {
+        // paint the current state now, re-enabling only schedules an update
+        // which would be suppressed again right away
+        hold(false);
+        m_widget->repaint();
+        hold(flood);
+    }
+    if (!m_bytes)
+        m_timer.stop();
+    m_bytes = 0;
+}
+
+void FrameScheduler::setSynchronized(bool synchronized)
+{
+    if (!synchronized)
+        m_syncExpired = false;
+    synchronized = synchronized && !m_syncExpired;
+    if (synchronized == m_synchronized)
+        return;
+
+    m_synchronized = synchronized;
+    if (synchronized)
+    {
+        m_syncTimer.start();
+        hold(true);
+    }
+    else
+    {
+        m_syncTimer.stop();
+        present();
+    }
+}
+
+void FrameScheduler::synchronizeTimeout()
+{
+    m_syncExpired = true;
+    m_synchronized = false;
+    present();
+}
+
+void FrameScheduler::present()
+{
+    // The display copies the screen on a timer of the emulation, which may
+    // not have fired since the update was closed. Copy it now so the paint
+    // shows the finished frame and not one drawn halfway.
+    if (m_display)
+        QMetaObject::invokeMethod(m_display, "updateImage", Qt::DirectConnection);
+    hold(false);
+    m_widget->repaint();
+    hold(m_bytes >= FLOOD_BYTES);
+}
+
+void FrameScheduler::hold(bool held)
+{
+    if (held == m_held)
+        return;
+    m_held = held;
+    m_widget->setUpdatesEnabled(!held);
+}
@@ -0,0 +1,102 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QTimer>
+
+class QWidget;
+
+
+/*! \brief Limits how often a terminal repaints while output floods in.
+
+The terminal parses output as fast as it arrives, but when more than a
+screenful or so comes in within one frame the widget stops painting and
+is repainted once per frame instead, showing only the latest state. Pages
+scrolled past in between are never drawn. Interactive output (typing,
+prompts) stays below the threshold and is painted right away as before.
+
+Programs that open a synchronized update (DEC private mode 2026) are not
+painted until they close it again, or for at most a safety timeout. The
+mode is picked out of the output as it arrives, before the display has had
+a chance to paint it, so a frame is shown once the program has finished
+it. A chunk that closes one update and opens the next leaves the painting
+held, the display has already taken in the start of the next frame.
+
+Panes without the focus get a lower frame rate during floods, and panes
+throttled by the user a lower one still, so busy background panes leave
+the event loop to typing and to the focused pane.
+*/
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+
+    public:
+        explicit FrameScheduler(QWidget * widget);
+
+        /*! Frames per second during a flood for the focused pane, panes
+            without focus and throttled panes. 0 paints every update.
+         */
+        void setFrameRates(int focused, int background, int throttled);
+        void setFocused(bool focused);
+        void setThrottled(bool throttled);
+        //! Call with every chunk of output right after the emulation has taken it
+        void dataReceived(const QByteArray & data);
+
+    signals:
+        //! The program asked for the state of \a mode (DECRQM), only 2026 is answered
+        void modeQueried(int mode, bool set);
+
+    private slots:
+        void frame();
+        void synchronizeTimeout();
+
+    private:
+        void applyFrameRate();
+        //! Returns true if the chunk closed a synchronized update somewhere
+        bool scan(const QByteArray & data);
+        void handleCsi(bool & closed);
+        void setSynchronized(bool synchronized);
+        void hold(bool held);
+        void present();
+
+        QWidget * m_widget;
+        QWidget * m_display;
+        QTimer m_timer;
+        QTimer m_syncTimer;
+        int m_focusedFps;
+        int m_backgroundFps;
+        int m_throttledFps;
+        bool m_focused;
+        bool m_throttled;
+        int m_bytes;
+        bool m_held;
+        bool m_synchronized;
+        // the update timed out, ignored until the program closes it
+        bool m_syncExpired;
+        // what the program asked for, m_synchronized is what is applied
+        bool m_requested;
+        enum ScanState { Ground, Escape, Csi };
+        ScanState m_scanState;
+        QByteArray m_seq;
+};
+
+#endif
@@ -0,0 +1,132 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QCoreApplication>
+#include <QStandardPaths>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QDir>
+#include <QDebug>
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "historydir.h"
+
+
+static QTemporaryDir * historyDir = 0;
+
+// '-' separates the parts of the directory name, see removeStale()
+static QString hostName()
+{
+    return QSysInfo::machineHostName().replace('/', '_');
+}
+
+static void removeHistoryDir()
+{
+    delete historyDir;
+    historyDir = 0;
+}
+
+QString HistoryDir::path()
+{
+    if (!historyDir)
+    {
+        QString base = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+        if (base.isEmpty() || !QDir().mkpath(base))
+            base = QDir::tempPath();
+        removeStale(base);
+
+        // QTemporaryDir creates the directory with 0700 permissions
+        historyDir = new QTemporaryDir(QString("%1/history-%2-%3-XXXXXX").arg(base, hostName())
+                                       .arg(QCoreApplication::applicationPid()));
+        if (!historyDir->isValid())
+        {
+            qWarning() << "Cannot create private history directory in" << base;
+            return QString();
+        }
+        qDebug() << "History files are kept in" << historyDir->path();
+        // remove the directory when qterminal quits
+        qAddPostRoutine(removeHistoryDir);
+    }
+
+    return historyDir->isValid() ? historyDir->path() : QString();
+}
+
+QStringList HistoryDir::files()
+{
+    if (!historyDir || !historyDir->isValid())
+        return QStringList();
+
+    // named after QTemporaryFile's default template
+    QDir dir(historyDir->path());
+    return dir.entryList(QStringList(QCoreApplication::applicationName() + ".*"), QDir::Files | QDir::Hidden);
+}
+
+void HistoryDir::unlinkFiles(const QStringList & existing)
+{
+    QDir dir(historyDir ? historyDir->path() : QString());
+    foreach (const QString & name, files())
+    {
+        if (!existing.contains(name))
+            ::unlink(QFile::encodeName(dir.absoluteFilePath(name)).constData());
+    }
+}
+
+void HistoryDir::removeStale(const QString & base)
+{
+    QDir dir(base);
+    foreach (const QString & name, dir.entryList(QStringList() << "history-*", QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        // history-<host>-<pid>-XXXXXX, the host may contain '-' itself.
+        // A pid only means something on its own host.
+        if (name.section('-', 1, -3) != hostName())
+            continue;
+        bool ok;
+        qint64 pid = name.section('-', -2, -2).toLongLong(&ok);
+        if (!ok || pid == QCoreApplication::applicationPid())
+            continue;
+        if (::kill(pid, 0) == 0 || errno != ESRCH)
+            continue;
+        QDir(dir.absoluteFilePath(name)).removeRecursively();
+    }
+}
+
+
+HistoryTempPath::HistoryTempPath()
+    : m_original(qgetenv("TMPDIR")),
+      m_wasSet(qEnvironmentVariableIsSet("TMPDIR")),
+      m_changed(false)
+{
+    QString dir = HistoryDir::path();
+    if (dir.isEmpty())
+        return;
+    qputenv("TMPDIR", QFile::encodeName(dir));
+    m_changed = true;
+}
+
+HistoryTempPath::~HistoryTempPath()
+{
+    if (!m_changed)
+        return;
+    if (m_wasSet)
+        qputenv("TMPDIR", m_original);
+    else
+        qunsetenv("TMPDIR");
+}
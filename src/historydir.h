@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef HISTORYDIR_H
+#define HISTORYDIR_H
+
+#include <QByteArray>
+#include <QStringList>
+
+
+/*! \brief Private directory for on-disk terminal history.
+
+The directory lives in the user's cache location (which, unlike /tmp, is
+rarely a tmpfs and so doesn't count against RAM), is only accessible by the
+owner and is removed when qterminal exits. Directories left behind by
+crashed instances on this host are cleaned up on first use; the cache may
+be shared with other hosts, so the directory is named after both the host
+and the process.
+
+qtermwidget creates the files of unlimited history in TMPDIR, so the
+directory is made the TMPDIR just while they are created, see
+HistoryTempPath. The files are expected to be unlinked right after they
+have been created and opened, see unlinkFiles(), so nothing can be read
+from them by anyone else and nothing is left on disk after a crash.
+*/
+class HistoryDir
+{
+    public:
+        //! Absolute path of the directory, empty if it cannot be created
+        static QString path();
+        //! The temporary files in the directory
+        static QStringList files();
+        //! Unlink the temporary files but \a existing. Open files stay usable.
+        static void unlinkFiles(const QStringList & existing);
+
+    private:
+        static void removeStale(const QString & base);
+};
+
+
+/*! \brief Makes the HistoryDir the TMPDIR for as long as it lives.
+
+Only for the GUI thread and only around calls that create the history
+files, so programs started from qterminal (the shells, xdg-open and what
+it launches) keep the TMPDIR qterminal was started with.
+*/
+class HistoryTempPath
+{
+    public:
+        HistoryTempPath();
+        ~HistoryTempPath();
+
+    private:
+        Q_DISABLE_COPY(HistoryTempPath)
+
+        QByteArray m_original;
+        bool m_wasSet;
+        bool m_changed;
+};
+
+#endif
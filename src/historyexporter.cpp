@@ -0,0 +1,121 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QThreadPool>
+#include <QSaveFile>
+#include <QDateTime>
+
+#include "historyexporter.h"
+
+
+HistoryExporter::HistoryExporter(const TermHistorySnapshot & history, const QString & fileName, Format format)
+    : QObject(0),
+      m_history(history),
+      m_fileName(fileName),
+      m_format(format),
+      m_timestamps(false),
+      m_cancelled(0)
+{
+    setAutoDelete(false);
+}
+
+void HistoryExporter::start()
+{
+    QThreadPool::globalInstance()->start(this);
+}
+
+void HistoryExporter::cancel()
+{
+    m_cancelled.store(1);
+}
+
+void HistoryExporter::report(bool ok, const QString & error)
+{
+    // the object may be gone as soon as the call is queued, see finish()
+    QMetaObject::invokeMethod(this, "finish", Qt::QueuedConnection, Q_ARG(bool, ok), Q_ARG(QString, error));
+}
+
+void HistoryExporter::finish(bool ok, const QString & error)
+{
+    emit finished(ok, error);
+    deleteLater();
+}
+
+void HistoryExporter::run()
+{
+    QSaveFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        report(false, file.errorString());
+        return;
+    }
+
+    int blocks = m_history.blockCount();
+    int percent = -1;
+    QByteArray chunk;
+    for (int i = 0; i < blocks; ++i)
+    {
+        // QSaveFile drops the temporary file unless it's committed
+        if (m_cancelled.load())
+        {
+            report(false, QString());
+            return;
+        }
+
+        chunk.clear();
+        QList<QByteArray> lines = m_history.blockLines(i);
+        QVector<qint64> times = m_timestamps ? m_history.blockTimes(i) : QVector<qint64>();
+        for (int j = 0; j < lines.count(); ++j)
+        {
+            if (m_timestamps)
+            {
+                qint64 time = times.value(j);
+                chunk += '[';
+                chunk += time ? QDateTime::fromMSecsSinceEpoch(time).toString("yyyy-MM-dd hh:mm:ss.zzz").toLatin1()
+                              : QByteArray(23, ' ');
+                chunk += "] ";
+            }
+            chunk += m_format == AnsiText ? lines.at(j) : TermHistory::stripAttributes(lines.at(j));
+            chunk += '\n';
+        }
+        if (file.write(chunk) != chunk.size())
+        {
+            report(false, file.errorString());
+            return;
+        }
+
+        if ((i + 1) * 100 / blocks != percent)
+        {
+            percent = (i + 1) * 100 / blocks;
+            emit progress(percent);
+        }
+    }
+
+    if (m_format == AnsiText && file.write("\x1b[0m") != 4)
+    {
+        report(false, file.errorString());
+        return;
+    }
+
+    if (!file.commit())
+    {
+        report(false, file.errorString());
+        return;
+    }
+    report(true, QString());
+}
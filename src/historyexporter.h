@@ -0,0 +1,79 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef HISTORYEXPORTER_H
+#define HISTORYEXPORTER_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QAtomicInt>
+
+#include "termhistory.h"
+
+
+/*! \brief Writes a terminal history to a file on the thread pool.
+
+The history is streamed block by block from a TermHistorySnapshot, so the
+whole buffer never exists as a single string. The file is written through
+QSaveFile, a cancelled or failed export leaves no partial file behind.
+
+finished() is emitted on the thread of the object, which deletes itself
+afterwards.
+*/
+class HistoryExporter : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+    public:
+        enum Format {
+            PlainText,
+            //! keep the colors and text attributes as SGR sequences
+            AnsiText
+        };
+
+        HistoryExporter(const TermHistorySnapshot & history, const QString & fileName, Format format);
+
+        //! Prefix every line with the time it arrived
+        void setTimestamps(bool timestamps) { m_timestamps = timestamps; }
+
+        void run();
+
+    public slots:
+        void start();
+        void cancel();
+
+    signals:
+        void progress(int percent);
+        //! \a error is empty when the export has been cancelled
+        void finished(bool ok, const QString & error);
+
+    private slots:
+        void finish(bool ok, const QString & error);
+
+    private:
+        //! Hand the result over to finish(), the last thing run() does
+        void report(bool ok, const QString & error);
+
+        TermHistorySnapshot m_history;
+        QString m_fileName;
+        Format m_format;
+        bool m_timestamps;
+        QAtomicInt m_cancelled;
+};
+
+#endif
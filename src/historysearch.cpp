@@ -0,0 +1,174 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QRunnable>
+
+#include "historysearch.h"
+
+
+namespace {
+
+class SearchTask : public QRunnable
+{
+    public:
+        SearchTask(HistorySearch * search, int generation, QSharedPointer<QAtomicInt> cancelled,
+                   uint terminal, const TermHistorySnapshot & history, int first, int last,
+                   const QRegularExpression & regexp)
+            : m_search(search),
+              m_generation(generation),
+              m_cancelled(cancelled),
+              m_terminal(terminal),
+              m_history(history),
+              m_first(first),
+              m_last(last),
+              m_regexp(regexp)
+        {
+        }
+
+        void run()
+        {
+            QList<SearchHit> hits;
+            for (int block = m_last - 1; block >= m_first && !m_cancelled->load(); --block)
+            {
+                QList<QByteArray> lines = m_history.blockLines(block);
+                QVector<qint64> times = m_history.blockTimes(block);
+                qint64 first = m_history.blockFirstLine(block);
+                for (int i = lines.count() - 1; i >= 0; --i)
+                {
+                    QByteArray line = TermHistory::stripAttributes(lines.at(i));
+                    if (!m_regexp.match(QString::fromUtf8(line)).hasMatch())
+                        continue;
+
+                    SearchHit hit;
+                    hit.terminal = m_terminal;
+                    hit.line = first + i;
+                    hit.time = times.value(i);
+                    hit.text = line;
+                    hit.score = 1;
+                    hits.append(hit);
+                }
+            }
+            QMetaObject::invokeMethod(m_search, "chunkDone", Qt::QueuedConnection,
+                                      Q_ARG(int, m_generation),
+                                      Q_ARG(QList<SearchHit>, hits));
+        }
+
+    private:
+        HistorySearch * m_search;
+        int m_generation;
+        QSharedPointer<QAtomicInt> m_cancelled;
+        uint m_terminal;
+        TermHistorySnapshot m_history;
+        int m_first;
+        int m_last;
+        QRegularExpression m_regexp;
+};
+
+}
+
+
+HistorySearch::HistorySearch(QObject * parent)
+    : QObject(parent),
+      m_regexps(32),
+      m_generation(0),
+      m_pending(0),
+      m_found(0)
+{
+    // make sure the metatypes used by chunkDone() are registered
+    SearchIndex::Instance();
+}
+
+HistorySearch::~HistorySearch()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+QRegularExpression HistorySearch::compile(const QString & pattern, bool caseSensitive)
+{
+    QString key = (caseSensitive ? QLatin1Char('1') : QLatin1Char('0')) + pattern;
+    if (QRegularExpression * cached = m_regexps.object(key))
+        return *cached;
+
+    QRegularExpression regexp(pattern, caseSensitive ? QRegularExpression::NoPatternOption
+                                                     : QRegularExpression::CaseInsensitiveOption);
+    if (regexp.isValid())
+    {
+        regexp.optimize();
+        m_regexps.insert(key, new QRegularExpression(regexp));
+    }
+    return regexp;
+}
+
+bool HistorySearch::start(const SearchSnapshots & terminals, const QString & pattern, bool caseSensitive)
+{
+    cancel();
+
+    QRegularExpression regexp = compile(pattern, caseSensitive);
+    if (!regexp.isValid())
+    {
+        m_error = regexp.errorString();
+        return false;
+    }
+    m_error.clear();
+
+    m_cancelled = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+    m_found = 0;
+    for (SearchSnapshots::const_iterator it = terminals.constBegin(); it != terminals.constEnd(); ++it)
+    {
+        // newest chunks first, the pool runs them in order
+        for (int last = it.value().blockCount(); last > 0; last -= ChunkBlocks)
+        {
+            m_pool.start(new SearchTask(this, m_generation, m_cancelled, it.key(), it.value(),
+                                        qMax(0, last - ChunkBlocks), last, regexp));
+            ++m_pending;
+        }
+    }
+
+    if (!m_pending)
+        emit finished();
+    return true;
+}
+
+void HistorySearch::cancel()
+{
+    if (m_cancelled)
+        m_cancelled->store(1);
+    m_pool.clear();
+    // results of the old search which are still on their way get ignored
+    ++m_generation;
+    m_pending = 0;
+}
+
+void HistorySearch::chunkDone(int generation, const QList<SearchHit> & hits)
+{
+    if (generation != m_generation)
+        return;
+
+    if (!hits.isEmpty())
+    {
+        m_found += hits.count();
+        emit hitsFound(hits);
+    }
+
+    if (m_found >= SearchIndex::MaxHits)
+        cancel();
+    else if (--m_pending > 0)
+        return;
+    emit finished();
+}
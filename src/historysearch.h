@@ -0,0 +1,79 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef HISTORYSEARCH_H
+#define HISTORYSEARCH_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QRegularExpression>
+#include <QCache>
+#include <QSharedPointer>
+#include <QAtomicInt>
+
+#include "searchindex.h"
+
+
+/*! \brief Regular expression search over terminal histories.
+
+The histories are split into chunks of a few TermHistory blocks which are
+matched on a thread pool, newest first. Hits are reported as soon as a
+chunk is done, so the first ones show up long before a huge history has
+been searched. Starting a new search cancels the running one.
+
+Compiled expressions are cached, so typing does not recompile the
+patterns seen a moment ago.
+*/
+class HistorySearch : public QObject
+{
+    Q_OBJECT
+
+    public:
+        enum { ChunkBlocks = 4 };
+
+        explicit HistorySearch(QObject * parent = 0);
+        ~HistorySearch();
+
+        //! Returns false (and does not search) if \a pattern is invalid, see errorString()
+        bool start(const SearchSnapshots & terminals, const QString & pattern, bool caseSensitive);
+        bool isRunning() const { return m_pending > 0; }
+        QString errorString() const { return m_error; }
+
+    public slots:
+        void cancel();
+
+    signals:
+        void hitsFound(const QList<SearchHit> & hits);
+        void finished();
+
+    private slots:
+        void chunkDone(int generation, const QList<SearchHit> & hits);
+
+    private:
+        QRegularExpression compile(const QString & pattern, bool caseSensitive);
+
+        QThreadPool m_pool;
+        QCache<QString, QRegularExpression> m_regexps;
+        QSharedPointer<QAtomicInt> m_cancelled;
+        int m_generation;
+        int m_pending;
+        int m_found;
+        QString m_error;
+};
+
+#endif
@@ -0,0 +1,285 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QRunnable>
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+#include <QDir>
+
+#include "historystore.h"
+#include "tabwidget.h"
+#include "termwidgetholder.h"
+#include "termhistory.h"
+#include "properties.h"
+
+#define INDEX_FILE "tabs"
+#define INDEX_MAGIC 0x51544831 // "QTH1"
+
+HistoryStore * HistoryStore::m_instance = 0;
+
+// set while a periodic save is queued or running
+static QAtomicInt SaveRunning;
+// cleared when persistence is turned off, saves still queued are skipped
+static QAtomicInt SaveEnabled;
+
+
+namespace {
+
+struct SavedTerminal
+{
+    QString fileName;
+    TermHistorySnapshot history;
+};
+
+// window-tab-pane.qth
+QString terminalFile(int window, int tab, int pane)
+{
+    return QString("%1-%2-%3.qth").arg(window).arg(tab).arg(pane);
+}
+
+class SaveTask : public QRunnable
+{
+    public:
+        SaveTask(const QString & dir, const QList<SavedTerminal> & terminals, const QByteArray & index, bool background)
+            : m_dir(dir),
+              m_terminals(terminals),
+              m_index(index),
+              m_background(background)
+        {
+        }
+
+        void run()
+        {
+            QDir dir(m_dir);
+            if (SaveEnabled.load() && dir.mkpath("."))
+            {
+                QFile::setPermissions(m_dir, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+
+                QStringList names;
+                foreach (const SavedTerminal & term, m_terminals)
+                {
+                    TermHistory::save(term.history, dir.filePath(term.fileName));
+                    names.append(term.fileName);
+                }
+
+                // the index goes last so it never refers to missing files
+                QSaveFile index(dir.filePath(INDEX_FILE));
+                if (index.open(QIODevice::WriteOnly))
+                {
+                    index.write(m_index);
+                    index.commit();
+                }
+
+                // terminals closed since the last save
+                foreach (const QString & name, dir.entryList(QStringList("*.qth"), QDir::Files))
+                {
+                    if (!names.contains(name))
+                        dir.remove(name);
+                }
+            }
+
+            if (m_background)
+                SaveRunning.store(0);
+        }
+
+    private:
+        QString m_dir;
+        QList<SavedTerminal> m_terminals;
+        QByteArray m_index;
+        bool m_background;
+};
+
+class RemoveTask : public QRunnable
+{
+    public:
+        explicit RemoveTask(const QString & dir) : m_dir(dir) {}
+
+        void run()
+        {
+            QDir(m_dir).removeRecursively();
+        }
+
+    private:
+        QString m_dir;
+};
+
+}
+
+
+HistoryStore * HistoryStore::Instance()
+{
+    if (!m_instance)
+        m_instance = new HistoryStore(qApp);
+    return m_instance;
+}
+
+HistoryStore::HistoryStore(QObject * parent)
+    : QObject(parent),
+      m_restoredWindows(0),
+      m_loaded(false),
+      m_persistent(Properties::Instance()->historyPersistent)
+{
+    SaveEnabled.store(m_persistent);
+    // the saves and removals run one after another, in order
+    m_pool.setMaxThreadCount(1);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(saveLater()));
+}
+
+HistoryStore::~HistoryStore()
+{
+    // the save queued when the last window closed
+    m_pool.waitForDone();
+    m_instance = 0;
+}
+
+QString HistoryStore::directory()
+{
+    return Properties::Instance()->settingsDir() + "/history";
+}
+
+void HistoryStore::load()
+{
+    QFile index(QDir(directory()).filePath(INDEX_FILE));
+    if (!index.open(QIODevice::ReadOnly))
+        return;
+
+    // windows, each a list of tabs
+    QDataStream stream(&index);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic;
+    stream >> magic;
+    if (magic != INDEX_MAGIC)
+        return;
+    stream >> m_pending;
+    if (stream.status() != QDataStream::Ok)
+        m_pending.clear();
+}
+
+bool HistoryStore::restore(TabWidget * tabs, const QString & shell)
+{
+    m_windows.append(tabs);
+    if (!m_loaded)
+    {
+        m_loaded = true;
+        propertiesChanged();
+        if (Properties::Instance()->historyPersistent)
+            load();
+    }
+    if (m_pending.isEmpty())
+        return false;
+
+    int window = m_restoredWindows++;
+    QList<TabLayout> layouts = m_pending.takeFirst();
+    QDir dir(directory());
+    int restored = 0;
+    for (int tab = 0; tab < layouts.count(); ++tab)
+    {
+        QStringList files;
+        for (int pane = 0; pane < layouts.at(tab).paneCount(); ++pane)
+            files.append(dir.filePath(terminalFile(window, tab, pane)));
+        if (layouts.at(tab).restore(tabs, files, restored == 0 ? shell : QString()) >= 0)
+            ++restored;
+    }
+
+    qDebug() << "Restored" << restored << "tabs from" << dir.path();
+    return restored > 0;
+}
+
+void HistoryStore::save(TabWidget * tabs)
+{
+    m_windows.removeAll(tabs);
+    m_windows.removeAll(0);
+    if (!Properties::Instance()->historyPersistent)
+        return;
+
+    // the other windows are what is left to restore
+    QList<TabWidget*> windows;
+    foreach (TabWidget * window, m_windows)
+        windows.append(window);
+    if (windows.isEmpty())
+        windows.append(tabs);
+    saveWindows(windows, false);
+}
+
+void HistoryStore::saveLater()
+{
+    m_windows.removeAll(0);
+    // skip this round if the previous save is still running
+    if (m_windows.isEmpty() || !SaveRunning.testAndSetOrdered(0, 1))
+        return;
+
+    QList<TabWidget*> windows;
+    foreach (TabWidget * window, m_windows)
+        windows.append(window);
+    saveWindows(windows, true);
+}
+
+void HistoryStore::saveWindows(const QList<TabWidget*> & windows, bool background)
+{
+    // only snapshots are taken here, compressing and writing is left to m_pool
+    QList<SavedTerminal> terminals;
+    QList<QList<TabLayout> > layouts;
+    foreach (TabWidget * tabs, windows)
+    {
+        int window = layouts.count();
+        QList<TabLayout> tabLayouts;
+        for (int tab = 0; tab < tabs->count(); ++tab)
+        {
+            TermWidgetHolder * holder = qobject_cast<TermWidgetHolder*>(tabs->widget(tab));
+            QList<TermWidget*> terms;
+            TabLayout layout = TabLayout::capture(holder, tabs->customTabName(tab), terms);
+            if (layout.isEmpty())
+                continue;
+            for (int pane = 0; pane < terms.count(); ++pane)
+            {
+                SavedTerminal term;
+                term.fileName = terminalFile(window, tabLayouts.count(), pane);
+                term.history = terms.at(pane)->impl()->history()->snapshot();
+                terminals.append(term);
+            }
+            tabLayouts.append(layout);
+        }
+        if (!tabLayouts.isEmpty())
+            layouts.append(tabLayouts);
+    }
+
+    QByteArray index;
+    QDataStream stream(&index, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << quint32(INDEX_MAGIC) << layouts;
+    m_pool.start(new SaveTask(directory(), terminals, index, background));
+}
+
+void HistoryStore::propertiesChanged()
+{
+    bool wasPersistent = m_persistent;
+    m_persistent = Properties::Instance()->historyPersistent;
+    SaveEnabled.store(m_persistent);
+    if (!m_persistent)
+    {
+        m_timer.stop();
+        // nothing should be left behind once the user turned it off
+        if (wasPersistent)
+            m_pool.start(new RemoveTask(directory()));
+        return;
+    }
+
+    m_timer.start(qMax(1, Properties::Instance()->historyPersistInterval) * 60 * 1000);
+}
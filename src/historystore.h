@@ -0,0 +1,91 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef HISTORYSTORE_H
+#define HISTORYSTORE_H
+
+#include <QObject>
+#include <QPointer>
+#include <QThreadPool>
+#include <QTimer>
+
+#include "tablayout.h"
+
+class TabWidget;
+
+
+/*! \brief Keeps the windows, tabs and terminal histories across restarts.
+
+The open windows are saved when the last of them is closed and
+periodically into the "history" directory next to the settings file: a
+compressed TermHistory file per terminal and an index with the TabLayout
+of every tab. A window closed while others stay open is forgotten.
+
+At the next start the first window recreates the first saved window and
+opens one more window for each of the others. Every terminal gets its file
+passed on creation and shows the most recent lines above a separator. The
+rest stays compressed until it is needed (search, export).
+
+The histories are compressed and written on a thread of its own, closing
+the last window only queues the save; it is waited for on exit.
+*/
+class HistoryStore : public QObject
+{
+    Q_OBJECT
+
+    public:
+        static HistoryStore * Instance();
+        ~HistoryStore();
+
+        /*! Register the window of \a tabs and recreate the next saved
+            window in it, the first tab runs \a shell. Returns false if it
+            has not restored anything.
+         */
+        bool restore(TabWidget * tabs, const QString & shell);
+        //! True while saved windows wait for their restore()
+        bool hasPendingWindows() const { return !m_pending.isEmpty(); }
+        //! The window of \a tabs closes, saves it if it is the last one
+        void save(TabWidget * tabs);
+
+    public slots:
+        void propertiesChanged();
+
+    private slots:
+        void saveLater();
+
+    private:
+        explicit HistoryStore(QObject * parent);
+        static QString directory();
+        void load();
+        void saveWindows(const QList<TabWidget*> & windows, bool background);
+
+        QList<QPointer<TabWidget> > m_windows;
+        // saved windows not restored yet, the tabs of each
+        QList<QList<TabLayout> > m_pending;
+        // the index of the next pending window in the saved file names
+        int m_restoredWindows;
+        bool m_loaded;
+        // historyPersistent as last applied, see propertiesChanged()
+        bool m_persistent;
+        QTimer m_timer;
+        QThreadPool m_pool;
+
+        static HistoryStore * m_instance;
+};
+
+#endif
@@ -0,0 +1,304 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QCoreApplication>
+#include <QFontDatabase>
+#include <QKeyEvent>
+#include <QLabel>
+#include <QMessageBox>
+#include <QVBoxLayout>
+
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "latencyprobe.h"
+#include "screenrecorder.h"
+#include "termwidget.h"
+
+// a key without output within this time is not followed any longer
+#define PROBE_TIMEOUT_NS 1000000000LL
+#define OVERLAY_INTERVAL_MS 500
+#define OVERLAY_MARGIN 8
+#define HISTOGRAM_BUCKETS 8
+#define HISTOGRAM_WIDTH 30
+#define ECHO_TEST_KEYS 200
+#define ECHO_TEST_INTERVAL_MS 30
+
+static const char * const StageNames[] = { "input", "wire", "render", "total" };
+
+static QString milliseconds(qint64 nsecs)
+{
+    return QString::number(nsecs / 1e6, 'f', 2).rightJustified(8);
+}
+
+
+LatencyProbe::LatencyProbe(TermWidgetImpl * term)
+    : QObject(term),
+      m_display(0),
+      m_overlay(0),
+      m_state(Idle),
+      m_key(0),
+      m_written(0),
+      m_exact(false),
+      m_echoed(0),
+      m_next(0)
+{
+    // the character grid, it has the keyboard focus and does the painting
+    foreach (QWidget * child, term->findChildren<QWidget*>())
+    {
+        if (QByteArray(child->metaObject()->className()).endsWith("TerminalDisplay"))
+            m_display = child;
+    }
+    if (m_display)
+        m_display->installEventFilter(this);
+
+    // emitted after the emulation has written the key to the pty
+    connect(term, SIGNAL(termKeyPressed(QKeyEvent*)), this, SLOT(keyWritten(QKeyEvent*)));
+    // the bytes themselves, only emitted by a teletype terminal
+    connect(term, SIGNAL(sendData(const char*,int)), this, SLOT(bytesWritten()));
+    connect(term, SIGNAL(receivedData(QString)), this, SLOT(dataReceived()));
+
+    m_overlayTimer.setInterval(OVERLAY_INTERVAL_MS);
+    connect(&m_overlayTimer, SIGNAL(timeout()), this, SLOT(updateOverlay()));
+    m_clock.start();
+}
+
+bool LatencyProbe::eventFilter(QObject * watched, QEvent * event)
+{
+    switch (event->type())
+    {
+        case QEvent::KeyPress:
+        {
+            int key = static_cast<QKeyEvent*>(event)->key();
+            if (key == Qt::Key_Shift || key == Qt::Key_Control || key == Qt::Key_Alt
+                || key == Qt::Key_AltGr || key == Qt::Key_Meta)
+                break;
+            qint64 now = m_clock.nsecsElapsed();
+            if (m_state == Idle || now - m_key > PROBE_TIMEOUT_NS)
+            {
+                m_key = now;
+                m_exact = false;
+                m_state = Writing;
+            }
+            break;
+        }
+        case QEvent::Paint:
+            if (m_state != Painting || ScreenRecorder::isCapturing())
+                break;
+            // the echo is visible once this paint is done, so time it too
+            watched->event(event);
+            addSample(m_clock.nsecsElapsed());
+            return true;
+        case QEvent::Resize:
+            if (m_overlay && m_overlay->isVisible())
+                updateOverlay();
+            break;
+        default:
+            break;
+    }
+    return false;
+}
+
+static bool sendsBytes(QKeyEvent * event)
+{
+    if (!event->text().isEmpty())
+        return true;
+    int key = event->key();
+    return (key >= Qt::Key_Escape && key <= Qt::Key_PageDown)
+           || (key >= Qt::Key_F1 && key <= Qt::Key_F35);
+}
+
+void LatencyProbe::keyWritten(QKeyEvent * event)
+{
+    if (m_state != Writing || m_exact)
+        return;
+    if (!sendsBytes(event))
+    {
+        // nothing went to the pty, there is no echo to wait for
+        m_state = Idle;
+        return;
+    }
+    m_written = m_clock.nsecsElapsed();
+    m_state = Echoing;
+}
+
+void LatencyProbe::bytesWritten()
+{
+    if (m_state == Writing || (m_state == Echoing && !m_exact))
+    {
+        m_written = m_clock.nsecsElapsed();
+        m_exact = true;
+        m_state = Echoing;
+    }
+}
+
+void LatencyProbe::dataReceived()
+{
+    if (m_state != Echoing)
+        return;
+    m_echoed = m_clock.nsecsElapsed();
+    m_state = Painting;
+}
+
+void LatencyProbe::addSample(qint64 painted)
+{
+    qint64 values[StageCount] = {
+        m_written - m_key, m_echoed - m_written, painted - m_echoed, painted - m_key
+    };
+    for (int i = 0; i < StageCount; ++i)
+    {
+        if (m_samples[i].count() < Capacity)
+            m_samples[i].append(values[i]);
+        else
+            m_samples[i][m_next] = values[i];
+    }
+    m_next = (m_next + 1) % Capacity;
+    m_state = Idle;
+}
+
+QString LatencyProbe::report() const
+{
+    int count = m_samples[Total].count();
+    if (!count)
+        return tr("No keypresses measured yet");
+
+    QString text = tr("Keypress latency in ms, last %1 keys").arg(count);
+    text += "\n             p50     p90     p99     max\n";
+    for (int i = 0; i < StageCount; ++i)
+    {
+        QVector<qint64> sorted = m_samples[i];
+        std::sort(sorted.begin(), sorted.end());
+        text += QString(StageNames[i]).leftJustified(8);
+        text += milliseconds(sorted.at(count / 2));
+        text += milliseconds(sorted.at(qMin(count - 1, count * 9 / 10)));
+        text += milliseconds(sorted.at(qMin(count - 1, count * 99 / 100)));
+        text += milliseconds(sorted.last()) + '\n';
+    }
+
+    // totals in power of two buckets: <1, <2, <4 ... >=64 ms
+    int histogram[HISTOGRAM_BUCKETS] = {};
+    foreach (qint64 nsecs, m_samples[Total])
+    {
+        qint64 ms = nsecs / 1000000;
+        int bucket = 0;
+        while (bucket < HISTOGRAM_BUCKETS - 1 && ms >= (1 << bucket))
+            ++bucket;
+        ++histogram[bucket];
+    }
+    int highest = *std::max_element(histogram, histogram + HISTOGRAM_BUCKETS);
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket)
+    {
+        QString label = bucket < HISTOGRAM_BUCKETS - 1
+                        ? QString("<%1").arg(1 << bucket)
+                        : QString(">=%1").arg(1 << (bucket - 1));
+        text += '\n' + label.rightJustified(5) + ' '
+                + QString(histogram[bucket] * HISTOGRAM_WIDTH / highest, '#')
+                + ' ' + QString::number(histogram[bucket]);
+    }
+    return text;
+}
+
+void LatencyProbe::showReport(QWidget * parent) const
+{
+    QMessageBox box(QMessageBox::Information, tr("Keypress Latency"),
+                    "<pre>" + report().toHtmlEscaped() + "</pre>", QMessageBox::Ok, parent);
+    box.setTextInteractionFlags(Qt::TextSelectableByMouse);
+    box.exec();
+}
+
+void LatencyProbe::setOverlayVisible(bool visible)
+{
+    if (!m_display || (!visible && !m_overlay))
+        return;
+
+    if (!m_overlay)
+    {
+        m_overlay = new QLabel(m_display);
+        m_overlay->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+        m_overlay->setStyleSheet("QLabel { background: rgba(0, 0, 0, 180); color: white; padding: 4px; }");
+        m_overlay->setAttribute(Qt::WA_TransparentForMouseEvents);
+    }
+    m_overlay->setVisible(visible);
+    if (visible)
+    {
+        updateOverlay();
+        m_overlayTimer.start();
+    }
+    else
+        m_overlayTimer.stop();
+}
+
+void LatencyProbe::updateOverlay()
+{
+    m_overlay->setText(report());
+    m_overlay->adjustSize();
+    m_overlay->move(m_display->width() - m_overlay->width() - OVERLAY_MARGIN, OVERLAY_MARGIN);
+}
+
+void LatencyProbe::runEchoTest(QWidget * parent)
+{
+    QWidget * window = new QWidget(parent, Qt::Tool);
+    window->setAttribute(Qt::WA_DeleteOnClose);
+    window->setWindowTitle(tr("Echo Latency Test"));
+    QVBoxLayout * layout = new QVBoxLayout(window);
+    TermWidgetImpl * term = new TermWidgetImpl(QString(), QString(), window,
+                                               TermWidgetImpl::ScratchMode);
+    layout->addWidget(term);
+    window->resize(480, 240);
+    window->show();
+    // no shell: a teletype hands the keys to sendData() instead of the pty,
+    // writing them to the slave side makes them come back as pty output
+    term->startTerminalTeletype();
+    int fd = term->getPtySlaveFd();
+    connect(term, &QTermWidget::sendData, window, [fd](const char * data, int size) {
+        QByteArray bytes(data, size);
+        bytes.replace('\r', "\r\n");
+        if (::write(fd, bytes.constData(), bytes.size()) < 0)
+            qWarning("echo test: writing to the pty failed");
+    });
+
+    LatencyProbe * probe = term->latencyProbe();
+    if (!probe->m_display)
+    {
+        window->close();
+        return;
+    }
+
+    QTimer * timer = new QTimer(window);
+    int sent = 0;
+    connect(timer, &QTimer::timeout, window, [=]() mutable {
+        if (sent == ECHO_TEST_KEYS)
+        {
+            timer->stop();
+            probe->showReport(window);
+            window->close();
+            return;
+        }
+        // a line every 40 keys keeps the pty's input queue from filling up
+        bool enter = sent % 40 == 39;
+        int key = enter ? int(Qt::Key_Return) : Qt::Key_A + sent % 26;
+        QString text = enter ? QString("\r") : QString(QChar('a' + sent % 26));
+        QKeyEvent press(QEvent::KeyPress, key, Qt::NoModifier, text);
+        QKeyEvent release(QEvent::KeyRelease, key, Qt::NoModifier, text);
+        QCoreApplication::sendEvent(probe->m_display, &press);
+        QCoreApplication::sendEvent(probe->m_display, &release);
+        ++sent;
+    });
+    timer->start(ECHO_TEST_INTERVAL_MS);
+}
@@ -0,0 +1,97 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef LATENCYPROBE_H
+#define LATENCYPROBE_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+class QKeyEvent;
+class QLabel;
+class TermWidgetImpl;
+
+
+/*! \brief Measures how long a keypress takes to show up on the screen.
+
+Each key is timestamped when the event arrives, once it has been written
+to the pty, when the first output after it is read (normally its echo)
+and when that output has been painted. Only one key is followed at a time;
+keys typed before the previous one was echoed are not measured, keys
+that send nothing are skipped and keys that produce no output are
+dropped after a second.
+
+A teletype terminal reports the bytes it sends, so the write is timed
+exactly there; with a shell the keypress signal stands in for it.
+
+The input and render stages are spent in the terminal, the wire stage in
+the shell, ssh and the network. The last Capacity keys are kept.
+*/
+class LatencyProbe : public QObject
+{
+    Q_OBJECT
+
+    public:
+        enum Stage { Input, Wire, Render, Total, StageCount };
+        enum { Capacity = 256 };
+
+        explicit LatencyProbe(TermWidgetImpl * term);
+
+        //! Median, p90, p99 and max per stage plus a histogram of the totals
+        QString report() const;
+        void showReport(QWidget * parent) const;
+        void setOverlayVisible(bool visible);
+
+        /*! Type into a private teletype terminal that writes every key back
+            through its pty, no shell involved, and show the report. This is
+            the terminal's own share.
+         */
+        static void runEchoTest(QWidget * parent);
+
+    protected:
+        bool eventFilter(QObject * watched, QEvent * event);
+
+    private slots:
+        void keyWritten(QKeyEvent * event);
+        void bytesWritten();
+        void dataReceived();
+        void updateOverlay();
+
+    private:
+        enum State { Idle, Writing, Echoing, Painting };
+
+        void addSample(qint64 painted);
+
+        QWidget * m_display;
+        QLabel * m_overlay;
+        QTimer m_overlayTimer;
+        QElapsedTimer m_clock;
+        State m_state;
+        qint64 m_key;
+        qint64 m_written;
+        // the write time came from sendData(), not from the keypress
+        bool m_exact;
+        qint64 m_echoed;
+        // ring buffers in nanoseconds, one sample per key in every stage
+        QVector<qint64> m_samples[StageCount];
+        int m_next;
+};
+
+#endif
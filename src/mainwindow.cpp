@@ -20,6 +20,10 @@
 #include <QDesktopWidget>
 #include <QToolButton>
 #include <QMessageBox>
+#include <QFileDialog>
+#include <QProgressDialog>
+#include <QPointer>
+#include <QTimer>
 
 #include "mainwindow.h"
 #include "tabwidget.h"
@@ -28,6 +32,11 @@
 #include "properties.h"
 #include "propertiesdialog.h"
 #include "bookmarkswidget.h"
+#include "memorypressure.h"
+#include "searchdialog.h"
+#include "screenhistorydialog.h"
+#include "historystore.h"
+#include "latencyprobe.h"
 
 
 // TODO/FXIME: probably remove. QSS makes it unusable on mac...
@@ -41,14 +50,14 @@ MainWindow::MainWindow(const QString& work_dir,
     : QMainWindow(parent,f),
       m_initShell(command),
       m_initWorkDir(work_dir),
+      m_searchDialog(0),
       m_dropLockButton(0),
       m_dropMode(dropMode)
 {
-    setAttribute(Qt::WA_TranslucentBackground);
-
     setupUi(this);
     Properties::Instance()->migrate_settings();
     Properties::Instance()->loadSettings();
+    applyTranslucency();
 
     m_bookmarksDock = new QDockWidget(tr("Bookmarks"), this);
     m_bookmarksDock->setObjectName("BookmarksDockWidget");
@@ -94,10 +103,16 @@ MainWindow::MainWindow(const QString& work_dir,
     setupCustomDirs();
 
     connect(consoleTabulator, &TabWidget::currentTitleChanged, this, &MainWindow::onCurrentTitleChanged);
+    connect(MemoryPressureMonitor::Instance(), SIGNAL(memoryPressure()),
+            consoleTabulator, SLOT(trimBackgroundHistory()));
     /* The tab should be added after all changes are made to
        the main window; otherwise, the initial prompt might
        get jumbled because of changes in internal geometry. */
-    consoleTabulator->addNewTab(command);
+    if (!HistoryStore::Instance()->restore(consoleTabulator, command))
+        consoleTabulator->addNewTab(command);
+    // the other saved windows, each of them opens the next one
+    if (HistoryStore::Instance()->hasPendingWindows())
+        QTimer::singleShot(0, this, SLOT(newTerminalWindow()));
 }
 
 MainWindow::~MainWindow()
@@ -266,6 +281,87 @@ void MainWindow::setup_ActionsMenu_Actions()
     menu_Actions->addAction(Properties::Instance()->actions[FIND]);
     addAction(Properties::Instance()->actions[FIND]);
 
+    Properties::Instance()->actions[FIND_ALL] = new QAction(QIcon::fromTheme("edit-find"), tr("Find in &All Terminals..."), this);
+    seq = QKeySequence::fromString( settings.value(FIND_ALL).toString() );
+    Properties::Instance()->actions[FIND_ALL]->setShortcut(seq);
+    connect(Properties::Instance()->actions[FIND_ALL], SIGNAL(triggered()), this, SLOT(findInAllTerminals()));
+    menu_Actions->addAction(Properties::Instance()->actions[FIND_ALL]);
+    addAction(Properties::Instance()->actions[FIND_ALL]);
+
+    Properties::Instance()->actions[FILTER_VIEW] = new QAction(QIcon::fromTheme("view-filter"), tr("Fi&lter View"), this);
+    seq = QKeySequence::fromString( settings.value(FILTER_VIEW).toString() );
+    Properties::Instance()->actions[FILTER_VIEW]->setShortcut(seq);
+    connect(Properties::Instance()->actions[FILTER_VIEW], SIGNAL(triggered()), this, SLOT(toggleFilterView()));
+    menu_Actions->addAction(Properties::Instance()->actions[FILTER_VIEW]);
+    addAction(Properties::Instance()->actions[FILTER_VIEW]);
+
+    Properties::Instance()->actions[SCREEN_HISTORY] = new QAction(tr("Scree&n History..."), this);
+    seq = QKeySequence::fromString( settings.value(SCREEN_HISTORY).toString() );
+    Properties::Instance()->actions[SCREEN_HISTORY]->setShortcut(seq);
+    connect(Properties::Instance()->actions[SCREEN_HISTORY], SIGNAL(triggered()), this, SLOT(showScreenHistory()));
+    menu_Actions->addAction(Properties::Instance()->actions[SCREEN_HISTORY]);
+    addAction(Properties::Instance()->actions[SCREEN_HISTORY]);
+
+    Properties::Instance()->actions[EXPORT_HISTORY] = new QAction(QIcon::fromTheme("document-save-as"), tr("E&xport History..."), this);
+    seq = QKeySequence::fromString( settings.value(EXPORT_HISTORY).toString() );
+    Properties::Instance()->actions[EXPORT_HISTORY]->setShortcut(seq);
+    connect(Properties::Instance()->actions[EXPORT_HISTORY], SIGNAL(triggered()), this, SLOT(exportHistory()));
+    menu_Actions->addAction(Properties::Instance()->actions[EXPORT_HISTORY]);
+    addAction(Properties::Instance()->actions[EXPORT_HISTORY]);
+
+    menu_Actions->addSeparator();
+
+    Properties::Instance()->actions[PREVIOUS_PROMPT] = new QAction(QIcon::fromTheme("go-up"), tr("Previous &Prompt"), this);
+    seq = QKeySequence::fromString( settings.value(PREVIOUS_PROMPT, PREVIOUS_PROMPT_SHORTCUT).toString() );
+    Properties::Instance()->actions[PREVIOUS_PROMPT]->setShortcut(seq);
+    connect(Properties::Instance()->actions[PREVIOUS_PROMPT], SIGNAL(triggered()), this, SLOT(previousPrompt()));
+    menu_Actions->addAction(Properties::Instance()->actions[PREVIOUS_PROMPT]);
+    addAction(Properties::Instance()->actions[PREVIOUS_PROMPT]);
+
+    Properties::Instance()->actions[NEXT_PROMPT] = new QAction(QIcon::fromTheme("go-down"), tr("Next P&rompt"), this);
+    seq = QKeySequence::fromString( settings.value(NEXT_PROMPT, NEXT_PROMPT_SHORTCUT).toString() );
+    Properties::Instance()->actions[NEXT_PROMPT]->setShortcut(seq);
+    connect(Properties::Instance()->actions[NEXT_PROMPT], SIGNAL(triggered()), this, SLOT(nextPrompt()));
+    menu_Actions->addAction(Properties::Instance()->actions[NEXT_PROMPT]);
+    addAction(Properties::Instance()->actions[NEXT_PROMPT]);
+
+    Properties::Instance()->actions[SELECT_OUTPUT] = new QAction(tr("Select Command &Output"), this);
+    seq = QKeySequence::fromString( settings.value(SELECT_OUTPUT).toString() );
+    Properties::Instance()->actions[SELECT_OUTPUT]->setShortcut(seq);
+    connect(Properties::Instance()->actions[SELECT_OUTPUT], SIGNAL(triggered()), this, SLOT(selectCommandOutput()));
+    menu_Actions->addAction(Properties::Instance()->actions[SELECT_OUTPUT]);
+    addAction(Properties::Instance()->actions[SELECT_OUTPUT]);
+
+    Properties::Instance()->actions[COPY_OUTPUT] = new QAction(QIcon::fromTheme("edit-copy"), tr("Copy &Last Output"), this);
+    seq = QKeySequence::fromString( settings.value(COPY_OUTPUT).toString() );
+    Properties::Instance()->actions[COPY_OUTPUT]->setShortcut(seq);
+    connect(Properties::Instance()->actions[COPY_OUTPUT], SIGNAL(triggered()), this, SLOT(copyLastOutput()));
+    menu_Actions->addAction(Properties::Instance()->actions[COPY_OUTPUT]);
+    addAction(Properties::Instance()->actions[COPY_OUTPUT]);
+
+    Properties::Instance()->actions[COMMAND_DURATION] = new QAction(tr("Command &Duration"), this);
+    seq = QKeySequence::fromString( settings.value(COMMAND_DURATION).toString() );
+    Properties::Instance()->actions[COMMAND_DURATION]->setShortcut(seq);
+    connect(Properties::Instance()->actions[COMMAND_DURATION], SIGNAL(triggered()), this, SLOT(showCommandDuration()));
+    menu_Actions->addAction(Properties::Instance()->actions[COMMAND_DURATION]);
+    addAction(Properties::Instance()->actions[COMMAND_DURATION]);
+
+    menu_Actions->addSeparator();
+
+    Properties::Instance()->actions[LATENCY_REPORT] = new QAction(tr("&Latency Report..."), this);
+    seq = QKeySequence::fromString( settings.value(LATENCY_REPORT).toString() );
+    Properties::Instance()->actions[LATENCY_REPORT]->setShortcut(seq);
+    connect(Properties::Instance()->actions[LATENCY_REPORT], SIGNAL(triggered()), this, SLOT(showLatencyReport()));
+    menu_Actions->addAction(Properties::Instance()->actions[LATENCY_REPORT]);
+    addAction(Properties::Instance()->actions[LATENCY_REPORT]);
+
+    Properties::Instance()->actions[LATENCY_TEST] = new QAction(tr("Echo Latency &Test..."), this);
+    seq = QKeySequence::fromString( settings.value(LATENCY_TEST).toString() );
+    Properties::Instance()->actions[LATENCY_TEST]->setShortcut(seq);
+    connect(Properties::Instance()->actions[LATENCY_TEST], SIGNAL(triggered()), this, SLOT(runLatencyTest()));
+    menu_Actions->addAction(Properties::Instance()->actions[LATENCY_TEST]);
+    addAction(Properties::Instance()->actions[LATENCY_TEST]);
+
 #if 0
     act = new QAction(this);
     act->setSeparator(true);
@@ -336,6 +432,13 @@ void MainWindow::setup_FileMenu_Actions()
     menu_File->addAction(Properties::Instance()->actions[CLOSE_TAB]);
     addAction(Properties::Instance()->actions[CLOSE_TAB]);
 
+    Properties::Instance()->actions[REOPEN_TAB] = new QAction(QIcon::fromTheme("edit-undo"), tr("&Reopen Closed Tab"), this);
+    seq = QKeySequence::fromString( settings.value(REOPEN_TAB).toString() );
+    Properties::Instance()->actions[REOPEN_TAB]->setShortcut(seq);
+    connect(Properties::Instance()->actions[REOPEN_TAB], SIGNAL(triggered()), consoleTabulator, SLOT(reopenClosedTab()));
+    menu_File->addAction(Properties::Instance()->actions[REOPEN_TAB]);
+    addAction(Properties::Instance()->actions[REOPEN_TAB]);
+
     Properties::Instance()->actions[NEW_WINDOW] = new QAction(QIcon::fromTheme("window-new"), tr("&New Window"), this);
     seq = QKeySequence::fromString( settings.value(NEW_WINDOW, NEW_WINDOW_SHORTCUT).toString() );
     Properties::Instance()->actions[NEW_WINDOW]->setShortcut(seq);
@@ -407,6 +510,26 @@ void MainWindow::setup_ViewMenu_Actions()
     connect(toggleFullscreen, SIGNAL(triggered(bool)), this, SLOT(showFullscreen(bool)));
     Properties::Instance()->actions[FULLSCREEN] = toggleFullscreen;
 
+    QAction *showTimestamps = new QAction(tr("Show &Timestamps"), this);
+    showTimestamps->setCheckable(true);
+    showTimestamps->setChecked(Properties::Instance()->timestampGutter);
+    seq = QKeySequence::fromString(settings.value(SHOW_TIMESTAMPS).toString());
+    showTimestamps->setShortcut(seq);
+    menu_Window->addAction(showTimestamps);
+    addAction(showTimestamps);
+    connect(showTimestamps, SIGNAL(triggered(bool)), this, SLOT(toggleTimestamps(bool)));
+    Properties::Instance()->actions[SHOW_TIMESTAMPS] = showTimestamps;
+
+    QAction *showLatency = new QAction(tr("Show &Latency Overlay"), this);
+    showLatency->setCheckable(true);
+    showLatency->setChecked(Properties::Instance()->latencyOverlay);
+    seq = QKeySequence::fromString(settings.value(SHOW_LATENCY).toString());
+    showLatency->setShortcut(seq);
+    menu_Window->addAction(showLatency);
+    addAction(showLatency);
+    connect(showLatency, SIGNAL(triggered(bool)), this, SLOT(toggleLatencyOverlay(bool)));
+    Properties::Instance()->actions[SHOW_LATENCY] = showLatency;
+
     Properties::Instance()->actions[TOGGLE_BOOKMARKS] = m_bookmarksDock->toggleViewAction();
     seq = QKeySequence::fromString( settings.value(TOGGLE_BOOKMARKS, TOGGLE_BOOKMARKS_SHORTCUT).toString() );
     Properties::Instance()->actions[TOGGLE_BOOKMARKS]->setShortcut(seq);
@@ -539,6 +662,18 @@ void MainWindow::toggleMenu()
     Properties::Instance()->menuVisible = m_menuBar->isVisible();
 }
 
+void MainWindow::toggleTimestamps(bool show)
+{
+    Properties::Instance()->timestampGutter = show;
+    consoleTabulator->propertiesChanged();
+}
+
+void MainWindow::toggleLatencyOverlay(bool show)
+{
+    Properties::Instance()->latencyOverlay = show;
+    consoleTabulator->propertiesChanged();
+}
+
 void MainWindow::showFullscreen(bool fullscreen)
 {
     if(fullscreen)
@@ -563,9 +698,8 @@ void MainWindow::closeEvent(QCloseEvent *ev)
             Properties::Instance()->mainWindowState = saveState();
         }
         Properties::Instance()->saveSettings();
-        for (int i = consoleTabulator->count(); i > 0; --i) {
-            consoleTabulator->removeTab(i - 1);
-        }
+        HistoryStore::Instance()->save(consoleTabulator);
+        consoleTabulator->removeAllTabs();
         ev->accept();
         return;
     }
@@ -594,9 +728,8 @@ void MainWindow::closeEvent(QCloseEvent *ev)
         Properties::Instance()->mainWindowState = saveState();
         Properties::Instance()->askOnExit = !dontAskCheck->isChecked();
         Properties::Instance()->saveSettings();
-        for (int i = consoleTabulator->count(); i > 0; --i) {
-            consoleTabulator->removeTab(i - 1);
-        }
+        HistoryStore::Instance()->save(consoleTabulator);
+        consoleTabulator->removeAllTabs();
         ev->accept();
     } else {
         ev->ignore();
@@ -620,10 +753,15 @@ void MainWindow::actProperties_triggered()
 void MainWindow::propertiesChanged()
 {
     QApplication::setStyle(Properties::Instance()->guiStyle);
-    setWindowOpacity(1.0 - Properties::Instance()->appTransparency/100.0);
+    qreal opacity = 1.0 - Properties::Instance()->appTransparency/100.0;
+    if (!qFuzzyCompare(windowOpacity(), opacity))
+        setWindowOpacity(opacity);
+    applyTranslucency();
     consoleTabulator->setTabPosition((QTabWidget::TabPosition)Properties::Instance()->tabsPos);
     consoleTabulator->propertiesChanged();
     setDropShortcut(Properties::Instance()->dropShortCut);
+    MemoryPressureMonitor::Instance()->setEnabled(Properties::Instance()->memoryPressureEnabled);
+    HistoryStore::Instance()->propertiesChanged();
 
     m_menuBar->setVisible(Properties::Instance()->menuVisible);
 
@@ -642,6 +780,25 @@ void MainWindow::propertiesChanged()
     realign();
 }
 
+void MainWindow::applyTranslucency()
+{
+    // An opaque window is cheaper to paint and to composite. Only the
+    // terminal transparency needs the alpha channel, the application
+    // transparency is a window opacity the compositor applies anyway.
+    bool translucent = Properties::Instance()->termTransparency > 0;
+    if (translucent == testAttribute(Qt::WA_TranslucentBackground))
+        return;
+
+    setAttribute(Qt::WA_TranslucentBackground, translucent);
+    if (isVisible())
+    {
+        // the native window gets the new format only when it is recreated
+        setWindowFlags(windowFlags());
+        show();
+        realign();
+    }
+}
+
 void MainWindow::realign()
 {
     if (m_dropMode)
@@ -698,6 +855,95 @@ void MainWindow::find()
     consoleTabulator->terminalHolder()->currentTerminal()->impl()->toggleShowSearchBar();
 }
 
+void MainWindow::findInAllTerminals()
+{
+    if (!m_searchDialog)
+        m_searchDialog = new SearchDialog(this);
+    m_searchDialog->show();
+    m_searchDialog->raise();
+    m_searchDialog->activateWindow();
+}
+
+void MainWindow::toggleFilterView()
+{
+    consoleTabulator->terminalHolder()->currentTerminal()->toggleFilterView();
+}
+
+void MainWindow::showScreenHistory()
+{
+    TermWidgetImpl * term = consoleTabulator->terminalHolder()->currentTerminal()->impl();
+    ScreenHistoryDialog * dialog = new ScreenHistoryDialog(term->screenRecorder(), this);
+    dialog->setWindowTitle(tr("Screen History - %1").arg(term->title()));
+    dialog->show();
+}
+
+void MainWindow::exportHistory()
+{
+    TermWidgetImpl * term = consoleTabulator->terminalHolder()->currentTerminal()->impl();
+
+    QString plainFilter = tr("Plain text (*.txt)");
+    QString timedFilter = tr("Plain text with times (*.log)");
+    QString ansiFilter = tr("Text with colors (*.ansi)");
+    QString filter;
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Export History"),
+                                                    term->workingDirectory(),
+                                                    plainFilter + ";;" + timedFilter + ";;" + ansiFilter,
+                                                    &filter);
+    if (fileName.isEmpty())
+        return;
+
+    HistoryExporter * exporter = term->exportHistory(fileName, filter == ansiFilter ? HistoryExporter::AnsiText
+                                                                                    : HistoryExporter::PlainText,
+                                                     filter == timedFilter);
+
+    QPointer<QProgressDialog> progress = new QProgressDialog(tr("Exporting history to %1").arg(fileName),
+                                                             tr("Cancel"), 0, 100, this);
+    progress->setAttribute(Qt::WA_DeleteOnClose);
+    progress->setMinimumDuration(500);
+    connect(exporter, SIGNAL(progress(int)), progress, SLOT(setValue(int)));
+    connect(progress, SIGNAL(canceled()), exporter, SLOT(cancel()));
+    connect(exporter, &HistoryExporter::finished, this, [this, progress, fileName] (bool ok, const QString & error) {
+        if (progress)
+            progress->close();
+        if (!ok && !error.isEmpty())
+            QMessageBox::warning(this, tr("Export History"), tr("Cannot write %1: %2").arg(fileName, error));
+    });
+}
+
+void MainWindow::previousPrompt()
+{
+    consoleTabulator->terminalHolder()->currentTerminal()->impl()->previousPrompt();
+}
+
+void MainWindow::nextPrompt()
+{
+    consoleTabulator->terminalHolder()->currentTerminal()->impl()->nextPrompt();
+}
+
+void MainWindow::selectCommandOutput()
+{
+    consoleTabulator->terminalHolder()->currentTerminal()->impl()->selectCommandOutput();
+}
+
+void MainWindow::copyLastOutput()
+{
+    consoleTabulator->terminalHolder()->currentTerminal()->impl()->copyLastOutput();
+}
+
+void MainWindow::showCommandDuration()
+{
+    consoleTabulator->terminalHolder()->currentTerminal()->impl()->showCommandDuration();
+}
+
+void MainWindow::showLatencyReport()
+{
+    consoleTabulator->terminalHolder()->currentTerminal()->impl()->latencyProbe()->showReport(this);
+}
+
+void MainWindow::runLatencyTest()
+{
+    LatencyProbe::runEchoTest(this);
+}
 
 bool MainWindow::event(QEvent *event)
 {
@@ -25,6 +25,7 @@
 #include "qxtglobalshortcut.h"
 
 class QToolButton;
+class SearchDialog;
 
 class MainWindow : public QMainWindow , private Ui::mainWindow
 {
@@ -49,6 +50,7 @@ private:
     QString m_initShell;
 
     QDockWidget *m_bookmarksDock;
+    SearchDialog *m_searchDialog;
 
     void setup_FileMenu_Actions();
     void setup_ActionsMenu_Actions();
@@ -62,6 +64,7 @@ private:
     bool m_dropMode;
     QxtGlobalShortcut m_dropShortcut;
     void realign();
+    void applyTranslucency();
     void setDropShortcut(QKeySequence dropShortCut);
 
 private slots:
@@ -74,11 +77,24 @@ private slots:
     void toggleBorderless();
     void toggleTabBar();
     void toggleMenu();
+    void toggleTimestamps(bool show);
+    void toggleLatencyOverlay(bool show);
 
     void showFullscreen(bool fullscreen);
     void showHide();
     void setKeepOpen(bool value);
     void find();
+    void findInAllTerminals();
+    void toggleFilterView();
+    void showScreenHistory();
+    void exportHistory();
+    void previousPrompt();
+    void nextPrompt();
+    void selectCommandOutput();
+    void copyLastOutput();
+    void showCommandDuration();
+    void showLatencyReport();
+    void runLatencyTest();
 
     void newTerminalWindow();
     void bookmarksWidget_callCommand(const QString&);
@@ -0,0 +1,235 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QSocketNotifier>
+#include <QFileSystemWatcher>
+#include <QPixmapCache>
+#include <QDateTime>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "memorypressure.h"
+#include "properties.h"
+
+// PSI keeps firing for as long as the stall lasts - don't shed on every wakeup
+#define MIN_PRESSURE_INTERVAL_MS 10000
+// unprivileged PSI triggers need a window that is a multiple of 2s
+#define PSI_WINDOW_US 2000000
+
+
+MemoryPressureMonitor * MemoryPressureMonitor::m_instance = 0;
+
+
+MemoryPressureMonitor * MemoryPressureMonitor::Instance()
+{
+    if (!m_instance)
+        m_instance = new MemoryPressureMonitor(qApp);
+    return m_instance;
+}
+
+MemoryPressureMonitor::MemoryPressureMonitor(QObject * parent)
+    : QObject(parent),
+      m_enabled(false),
+      m_psiFd(-1),
+      m_psiNotifier(0),
+      m_cgroupWatcher(0),
+      m_cgroupEvents(0),
+      m_lastEvent(0)
+{
+}
+
+MemoryPressureMonitor::~MemoryPressureMonitor()
+{
+    stop();
+    m_instance = 0;
+}
+
+void MemoryPressureMonitor::setEnabled(bool enabled)
+{
+    if (enabled == m_enabled)
+        return;
+
+    m_enabled = enabled;
+    if (!enabled)
+    {
+        stop();
+        return;
+    }
+
+    if (startPsi())
+        qDebug() << "Memory pressure: watching /proc/pressure/memory";
+    else if (startCgroup())
+        qDebug() << "Memory pressure: watching" << m_cgroupEventsFile;
+    else
+        qDebug() << "Memory pressure: no PSI or cgroup v2 memory events available";
+}
+
+bool MemoryPressureMonitor::startPsi()
+{
+#ifdef Q_OS_LINUX
+    m_psiFd = ::open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (m_psiFd < 0)
+        return false;
+
+    int stallUs = qBound(1, Properties::Instance()->memoryPressureStall, PSI_WINDOW_US / 1000 - 1) * 1000;
+    QByteArray trigger = QString("some %1 %2").arg(stallUs).arg(PSI_WINDOW_US).toLatin1();
+    // the trigger string has to include the terminating zero
+    if (::write(m_psiFd, trigger.constData(), trigger.size() + 1) < 0)
+    {
+        ::close(m_psiFd);
+        m_psiFd = -1;
+        return false;
+    }
+
+    // PSI triggers are reported as POLLPRI
+    m_psiNotifier = new QSocketNotifier(m_psiFd, QSocketNotifier::Exception, this);
+    connect(m_psiNotifier, SIGNAL(activated(int)), this, SLOT(psiTriggered()));
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool MemoryPressureMonitor::startCgroup()
+{
+#ifdef Q_OS_LINUX
+    QFile f("/proc/self/cgroup");
+    if (!f.open(QFile::ReadOnly))
+        return false;
+
+    QString path;
+    foreach (const QByteArray & line, f.readAll().split('\n'))
+    {
+        // cgroup v2 entry: "0::/user.slice/..."
+        if (line.startsWith("0::"))
+            path = QString::fromLocal8Bit(line.mid(3));
+    }
+    if (path.isEmpty())
+        return false;
+
+    // the root cgroup has no memory.events, climb up until we find one
+    QDir dir("/sys/fs/cgroup" + path);
+    while (!dir.exists("memory.events"))
+    {
+        if (dir.absolutePath() == "/sys/fs/cgroup" || !dir.cdUp())
+            return false;
+    }
+
+    m_cgroupEventsFile = dir.absoluteFilePath("memory.events");
+    m_cgroupEvents = readCgroupEvents();
+    m_cgroupWatcher = new QFileSystemWatcher(QStringList() << m_cgroupEventsFile, this);
+    connect(m_cgroupWatcher, SIGNAL(fileChanged(QString)), this, SLOT(cgroupEventsChanged()));
+    return true;
+#else
+    return false;
+#endif
+}
+
+void MemoryPressureMonitor::stop()
+{
+    delete m_psiNotifier;
+    m_psiNotifier = 0;
+    if (m_psiFd >= 0)
+    {
+        ::close(m_psiFd);
+        m_psiFd = -1;
+    }
+
+    delete m_cgroupWatcher;
+    m_cgroupWatcher = 0;
+    m_cgroupEventsFile.clear();
+}
+
+void MemoryPressureMonitor::psiTriggered()
+{
+    handlePressure("PSI");
+}
+
+void MemoryPressureMonitor::cgroupEventsChanged()
+{
+    // memory.events also changes for counters we don't care about
+    qint64 events = readCgroupEvents();
+    if (events <= m_cgroupEvents)
+        return;
+    m_cgroupEvents = events;
+    handlePressure("cgroup");
+}
+
+qint64 MemoryPressureMonitor::readCgroupEvents() const
+{
+    QFile f(m_cgroupEventsFile);
+    if (!f.open(QFile::ReadOnly))
+        return 0;
+
+    qint64 events = 0;
+    foreach (const QByteArray & line, f.readAll().split('\n'))
+    {
+        QList<QByteArray> parts = line.split(' ');
+        if (parts.count() != 2)
+            continue;
+        if (parts.at(0) == "high" || parts.at(0) == "max" || parts.at(0) == "oom")
+            events += parts.at(1).toLongLong();
+    }
+    return events;
+}
+
+void MemoryPressureMonitor::handlePressure(const char * source)
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (m_lastEvent && now - m_lastEvent < MIN_PRESSURE_INTERVAL_MS)
+        return;
+    m_lastEvent = now;
+
+    qint64 before = residentSetSize();
+
+    emit memoryPressure();
+
+    QPixmapCache::clear();
+#ifdef __GLIBC__
+    // hand the pages freed above back to the kernel
+    malloc_trim(0);
+#endif
+
+    qint64 after = residentSetSize();
+    qDebug() << "Memory pressure reported by" << source
+             << "- RSS" << before / 1024 << "KiB ->" << after / 1024 << "KiB,"
+             << "reclaimed" << qMax<qint64>(0, before - after) / 1024 << "KiB";
+}
+
+qint64 MemoryPressureMonitor::residentSetSize()
+{
+#ifdef Q_OS_LINUX
+    QFile f("/proc/self/statm");
+    if (!f.open(QFile::ReadOnly))
+        return -1;
+    // "size resident shared text lib data dt" in pages
+    QList<QByteArray> fields = f.readAll().split(' ');
+    if (fields.count() < 2)
+        return -1;
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,79 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef MEMORYPRESSURE_H
+#define MEMORYPRESSURE_H
+
+#include <QObject>
+
+class QSocketNotifier;
+class QFileSystemWatcher;
+
+
+/*! \brief Process wide watcher for system memory pressure.
+
+On Linux it arms a PSI trigger on /proc/pressure/memory. When the kernel
+does not provide PSI it falls back to the "high"/"max" counters of the
+cgroup v2 memory.events file of the current process.
+
+Every pressure event emits memoryPressure() so the windows can shed what
+they don't need right now. Afterwards the monitor drops Qt's pixmap cache,
+returns free heap pages to the OS and logs how much has been reclaimed.
+*/
+class MemoryPressureMonitor : public QObject
+{
+    Q_OBJECT
+
+    public:
+        static MemoryPressureMonitor * Instance();
+        ~MemoryPressureMonitor();
+
+        void setEnabled(bool enabled);
+        bool isEnabled() const { return m_enabled; }
+
+        //! Resident set size of this process in bytes, -1 if unknown
+        static qint64 residentSetSize();
+
+    signals:
+        void memoryPressure();
+
+    private slots:
+        void psiTriggered();
+        void cgroupEventsChanged();
+
+    private:
+        explicit MemoryPressureMonitor(QObject * parent = 0);
+
+        bool startPsi();
+        bool startCgroup();
+        void stop();
+        void handlePressure(const char * source);
+        qint64 readCgroupEvents() const;
+
+        static MemoryPressureMonitor * m_instance;
+
+        bool m_enabled;
+        int m_psiFd;
+        QSocketNotifier * m_psiNotifier;
+        QFileSystemWatcher * m_cgroupWatcher;
+        QString m_cgroupEventsFile;
+        qint64 m_cgroupEvents;
+        qint64 m_lastEvent;
+};
+
+#endif
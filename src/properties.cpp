@@ -16,6 +16,7 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
  ***************************************************************************/
 
+#include <QStandardPaths>
 #include <qtermwidget.h>
 
 #include "properties.h"
@@ -50,6 +51,11 @@ Properties::~Properties()
     m_instance = 0;
 }
 
+QString Properties::settingsDir() const
+{
+    return QFileInfo(m_settings->fileName()).absolutePath();
+}
+
 QFont Properties::defaultFont()
 {
     QFont default_font = QApplication::font();
@@ -87,6 +93,38 @@ void Properties::loadSettings()
 
     historyLimited = m_settings->value("HistoryLimited", true).toBool();
     historyLimitedTo = m_settings->value("HistoryLimitedTo", 1000).toUInt();
+    historyCompressed = m_settings->value("HistoryCompressed", false).toBool();
+    /* lines the terminal itself keeps when the rest is compressed */
+    historyHotLines = m_settings->value("HistoryHotLines", 1000).toInt();
+    /* copy of the output for search, export, the filter view and the command
+       marks; parsing every byte costs, so it is off unless asked for */
+    historySearch = m_settings->value("HistorySearch", false).toBool();
+    historyPersistent = m_settings->value("HistoryPersistent", false).toBool();
+    /* minutes between saves of the persistent history */
+    historyPersistInterval = m_settings->value("HistoryPersistInterval", 5).toInt();
+    /* outputs longer than HistoryElideLines keep HistoryElideKeep lines at both ends.
+       Off by default: the end of a long output reaches search and the filter
+       view only once the output stops */
+    historyElide = m_settings->value("HistoryElide", false).toBool();
+    historyElideLines = m_settings->value("HistoryElideLines", 20000).toInt();
+    historyElideKeep = m_settings->value("HistoryElideKeep", 2000).toInt();
+    historyElideSpill = m_settings->value("HistoryElideSpill", false).toBool();
+    /* screens of full screen programs, the budget is in MiB per terminal */
+    screenRecording = m_settings->value("ScreenRecording", false).toBool();
+    screenRecordingBudget = m_settings->value("ScreenRecordingBudget", 16).toInt();
+    /* recently closed tabs kept for reopening, the size of their histories is in MiB */
+    closedTabsCount = m_settings->value("ClosedTabsCount", 10).toInt();
+    closedTabsSize = m_settings->value("ClosedTabsSize", 64).toInt();
+    /* repaints per second while output floods in, 0 paints every update */
+    frameRate = m_settings->value("FrameRate", 60).toInt();
+    /* the same for panes without focus and for panes throttled from their context menu */
+    backgroundFrameRate = m_settings->value("BackgroundFrameRate", 20).toInt();
+    throttledFrameRate = m_settings->value("ThrottledFrameRate", 4).toInt();
+    /* load the fonts one zoom step up and down ahead of time */
+    prewarmZoomFonts = m_settings->value("PrewarmZoomFonts", true).toBool();
+    timestampGutter = m_settings->value("TimestampGutter", false).toBool();
+    timestampGutterRelative = m_settings->value("TimestampGutterRelative", false).toBool();
+    latencyOverlay = m_settings->value("LatencyOverlay", false).toBool();
 
     emulation = m_settings->value("emulation", "default").toString();
 
@@ -140,6 +178,26 @@ void Properties::loadSettings()
 
     changeWindowTitle = m_settings->value("ChangeWindowTitle", true).toBool();
     changeWindowIcon = m_settings->value("ChangeWindowIcon", true).toBool();
+
+    m_settings->beginGroup("MemoryPressure");
+    /* off by default, it drops history the user may want to scroll back to */
+    memoryPressureEnabled = m_settings->value("Enabled", false).toBool();
+    /* stall time (ms) within the 2s PSI window which counts as pressure */
+    memoryPressureStall = m_settings->value("Stall", 150).toInt();
+    /* background terminals with limited history keep this many lines */
+    memoryPressureHistoryFloor = m_settings->value("HistoryFloor", 1000).toInt();
+    m_settings->endGroup();
+
+    m_settings->beginGroup("SessionLog");
+    sessionLogEnabled = m_settings->value("Enabled", false).toBool();
+    sessionLogDir = m_settings->value("Directory",
+                                      QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/logs").toString();
+    /* rotate the logs after this many MB and hours, 0 to disable */
+    sessionLogMaxSize = m_settings->value("MaxSize", 16).toInt();
+    sessionLogRotateHours = m_settings->value("RotateHours", 24).toInt();
+    /* gzip the rotated logs (only if built with zlib) */
+    sessionLogCompress = m_settings->value("Compress", true).toBool();
+    m_settings->endGroup();
 }
 
 void Properties::saveSettings()
@@ -165,6 +223,26 @@ void Properties::saveSettings()
 
     m_settings->setValue("HistoryLimited", historyLimited);
     m_settings->setValue("HistoryLimitedTo", historyLimitedTo);
+    m_settings->setValue("HistoryCompressed", historyCompressed);
+    m_settings->setValue("HistoryHotLines", historyHotLines);
+    m_settings->setValue("HistorySearch", historySearch);
+    m_settings->setValue("HistoryPersistent", historyPersistent);
+    m_settings->setValue("HistoryPersistInterval", historyPersistInterval);
+    m_settings->setValue("HistoryElide", historyElide);
+    m_settings->setValue("HistoryElideLines", historyElideLines);
+    m_settings->setValue("HistoryElideKeep", historyElideKeep);
+    m_settings->setValue("HistoryElideSpill", historyElideSpill);
+    m_settings->setValue("ScreenRecording", screenRecording);
+    m_settings->setValue("ScreenRecordingBudget", screenRecordingBudget);
+    m_settings->setValue("ClosedTabsCount", closedTabsCount);
+    m_settings->setValue("ClosedTabsSize", closedTabsSize);
+    m_settings->setValue("FrameRate", frameRate);
+    m_settings->setValue("BackgroundFrameRate", backgroundFrameRate);
+    m_settings->setValue("ThrottledFrameRate", throttledFrameRate);
+    m_settings->setValue("PrewarmZoomFonts", prewarmZoomFonts);
+    m_settings->setValue("TimestampGutter", timestampGutter);
+    m_settings->setValue("TimestampGutterRelative", timestampGutterRelative);
+    m_settings->setValue("LatencyOverlay", latencyOverlay);
 
     m_settings->setValue("emulation", emulation);
 
@@ -214,6 +292,20 @@ void Properties::saveSettings()
 
     m_settings->setValue("ChangeWindowTitle", changeWindowTitle);
     m_settings->setValue("ChangeWindowIcon", changeWindowIcon);
+
+    m_settings->beginGroup("MemoryPressure");
+    m_settings->setValue("Enabled", memoryPressureEnabled);
+    m_settings->setValue("Stall", memoryPressureStall);
+    m_settings->setValue("HistoryFloor", memoryPressureHistoryFloor);
+    m_settings->endGroup();
+
+    m_settings->beginGroup("SessionLog");
+    m_settings->setValue("Enabled", sessionLogEnabled);
+    m_settings->setValue("Directory", sessionLogDir);
+    m_settings->setValue("MaxSize", sessionLogMaxSize);
+    m_settings->setValue("RotateHours", sessionLogRotateHours);
+    m_settings->setValue("Compress", sessionLogCompress);
+    m_settings->endGroup();
 }
 
 void Properties::migrate_settings()
@@ -41,6 +41,8 @@ class Properties
         void saveSettings();
         void loadSettings();
         void migrate_settings();
+        //! Directory of the settings file
+        QString settingsDir() const;
 
         QSize mainWindowSize;
         QPoint mainWindowPosition;
@@ -54,6 +56,9 @@ class Properties
 
         bool historyLimited;
         unsigned historyLimitedTo;
+        bool historyCompressed;
+        bool historySearch;
+        int historyHotLines;
 
         QString emulation;
 
@@ -94,6 +99,38 @@ class Properties
         bool changeWindowTitle;
         bool changeWindowIcon;
 
+        bool memoryPressureEnabled;
+        int memoryPressureStall;
+        int memoryPressureHistoryFloor;
+
+        bool sessionLogEnabled;
+        QString sessionLogDir;
+        int sessionLogMaxSize;
+        int sessionLogRotateHours;
+        bool sessionLogCompress;
+
+        bool historyPersistent;
+        int historyPersistInterval;
+        bool historyElide;
+        int historyElideLines;
+        int historyElideKeep;
+        bool historyElideSpill;
+
+        bool screenRecording;
+        int screenRecordingBudget;
+
+        int closedTabsCount;
+        int closedTabsSize;
+
+        int frameRate;
+        int backgroundFrameRate;
+        int throttledFrameRate;
+        bool prewarmZoomFonts;
+
+        bool timestampGutter;
+        bool timestampGutterRelative;
+        bool latencyOverlay;
+
         QMap< QString, QAction * > actions;
 
 
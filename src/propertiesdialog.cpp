@@ -113,6 +113,14 @@ PropertiesDialog::PropertiesDialog(QWidget *parent)
     historyUnlimited->setChecked(!Properties::Instance()->historyLimited);
     historyLimitedTo->setValue(Properties::Instance()->historyLimitedTo);
 
+    historyCompressedCheckBox->setChecked(Properties::Instance()->historyCompressed);
+    historySearchCheckBox->setChecked(Properties::Instance()->historySearch);
+    historyPersistentCheckBox->setChecked(Properties::Instance()->historyPersistent);
+    historyElideCheckBox->setChecked(Properties::Instance()->historyElide);
+    screenRecordingCheckBox->setChecked(Properties::Instance()->screenRecording);
+    memoryPressureCheckBox->setChecked(Properties::Instance()->memoryPressureEnabled);
+    sessionLogCheckBox->setChecked(Properties::Instance()->sessionLogEnabled);
+
     dropShowOnStartCheckBox->setChecked(Properties::Instance()->dropShowOnStart);
     dropHeightSpinBox->setValue(Properties::Instance()->dropHeight);
     dropWidthSpinBox->setValue(Properties::Instance()->dropWidht);
@@ -175,6 +183,13 @@ void PropertiesDialog::apply()
 
     Properties::Instance()->historyLimited = historyLimited->isChecked();
     Properties::Instance()->historyLimitedTo = historyLimitedTo->value();
+    Properties::Instance()->historyCompressed = historyCompressedCheckBox->isChecked();
+    Properties::Instance()->historySearch = historySearchCheckBox->isChecked();
+    Properties::Instance()->historyPersistent = historyPersistentCheckBox->isChecked();
+    Properties::Instance()->historyElide = historyElideCheckBox->isChecked();
+    Properties::Instance()->screenRecording = screenRecordingCheckBox->isChecked();
+    Properties::Instance()->memoryPressureEnabled = memoryPressureCheckBox->isChecked();
+    Properties::Instance()->sessionLogEnabled = sessionLogCheckBox->isChecked();
 
     saveShortcuts();
 
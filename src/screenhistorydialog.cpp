@@ -0,0 +1,77 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QDateTime>
+
+#include "screenhistorydialog.h"
+#include "screenrecorder.h"
+
+
+ScreenHistoryDialog::ScreenHistoryDialog(ScreenRecorder * recorder, QWidget * parent)
+    : QDialog(parent),
+      m_recorder(recorder)
+{
+    setupUi(this);
+    setAttribute(Qt::WA_DeleteOnClose);
+
+    recordCheckBox->setChecked(recorder->isEnabled());
+    frameSlider->setMaximum(-1);
+
+    connect(recorder, SIGNAL(framesChanged()), this, SLOT(framesChanged()));
+    // the terminal is gone
+    connect(recorder, SIGNAL(destroyed()), this, SLOT(close()));
+    connect(frameSlider, SIGNAL(valueChanged(int)), this, SLOT(showFrame(int)));
+    connect(recordCheckBox, SIGNAL(toggled(bool)), this, SLOT(setRecording(bool)));
+
+    framesChanged();
+}
+
+void ScreenHistoryDialog::framesChanged()
+{
+    bool follow = frameSlider->value() == frameSlider->maximum();
+    int frame = follow ? m_recorder->frameCount() - 1 : frameSlider->value();
+    frameSlider->blockSignals(true);
+    frameSlider->setMaximum(m_recorder->frameCount() - 1);
+    frameSlider->setValue(frame);
+    frameSlider->blockSignals(false);
+    // the frames may have moved when old ones were dropped
+    showFrame(frameSlider->value());
+}
+
+void ScreenHistoryDialog::showFrame(int frame)
+{
+    if (!m_recorder || frame < 0 || frame >= m_recorder->frameCount())
+    {
+        screenLabel->setText(tr("Nothing recorded yet, the screens of full screen programs are recorded while this terminal is."));
+        statusLabel->clear();
+        return;
+    }
+
+    screenLabel->setPixmap(QPixmap::fromImage(m_recorder->frame(frame)));
+    statusLabel->setText(tr("%1 (%2 of %3, %4 KiB)")
+                         .arg(QDateTime::fromMSecsSinceEpoch(m_recorder->frameTime(frame)).toString("hh:mm:ss.zzz"))
+                         .arg(frame + 1)
+                         .arg(m_recorder->frameCount())
+                         .arg(m_recorder->memoryUsage() / 1024));
+}
+
+void ScreenHistoryDialog::setRecording(bool record)
+{
+    if (m_recorder)
+        m_recorder->setEnabled(record);
+}
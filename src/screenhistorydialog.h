@@ -0,0 +1,49 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef SCREENHISTORYDIALOG_H
+#define SCREENHISTORYDIALOG_H
+
+#include <QPointer>
+
+#include "ui_screenhistorydialog.h"
+
+class ScreenRecorder;
+
+
+/*! \brief Step back through the screens kept by a ScreenRecorder.
+
+The slider follows new frames while it is at its end.
+*/
+class ScreenHistoryDialog : public QDialog, private Ui::ScreenHistoryDialog
+{
+    Q_OBJECT
+
+    public:
+        explicit ScreenHistoryDialog(ScreenRecorder * recorder, QWidget * parent = 0);
+
+    private slots:
+        void framesChanged();
+        void showFrame(int frame);
+        void setRecording(bool record);
+
+    private:
+        QPointer<ScreenRecorder> m_recorder;
+};
+
+#endif
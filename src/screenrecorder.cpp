@@ -0,0 +1,242 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QFontMetrics>
+#include <QDateTime>
+
+#include <string.h>
+
+#include "screenrecorder.h"
+#include "termwidget.h"
+#include "termhistory.h"
+
+// at most this often, full screen programs redraw far more frequently
+#define CAPTURE_INTERVAL_MS 200
+
+bool ScreenRecorder::m_capturing = false;
+
+
+ScreenRecorder::ScreenRecorder(TermWidgetImpl * term)
+    : QObject(term),
+      m_term(term),
+      m_display(term),
+      m_enabled(false),
+      m_painted(false),
+      m_pending(false),
+      m_budget(16 * 1024 * 1024),
+      m_bytes(0),
+      m_sinceKey(0)
+{
+    // the character grid, its paints tell when the output is on the screen
+    foreach (QWidget * child, term->findChildren<QWidget*>())
+    {
+        if (QByteArray(child->metaObject()->className()).endsWith("TerminalDisplay"))
+            m_display = child;
+    }
+    m_display->installEventFilter(this);
+
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(CAPTURE_INTERVAL_MS);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(captureDue()));
+    connect(term, SIGNAL(receivedData(QString)), this, SLOT(outputReceived()));
+}
+
+void ScreenRecorder::setEnabled(bool enabled)
+{
+    // the frames stay around for viewing
+    m_enabled = enabled;
+    if (!enabled)
+    {
+        m_timer.stop();
+        m_pending = false;
+    }
+}
+
+void ScreenRecorder::setBudget(qint64 bytes)
+{
+    m_budget = bytes;
+    dropOldFrames();
+}
+
+void ScreenRecorder::clear()
+{
+    m_frames.clear();
+    m_bytes = 0;
+    m_sinceKey = 0;
+    m_tileHashes.clear();
+    emit framesChanged();
+}
+
+void ScreenRecorder::outputReceived()
+{
+    m_painted = false;
+    // the capture waits a bit so a burst of output is captured once
+    if (m_enabled && !m_pending && m_term->history()->isAltScreen() && !m_timer.isActive())
+        m_timer.start();
+}
+
+void ScreenRecorder::captureDue()
+{
+    // not painted yet, or held by the FrameScheduler: wait for the paint
+    if (m_painted && m_term->updatesEnabled())
+        capture();
+    else
+        m_pending = true;
+}
+
+bool ScreenRecorder::eventFilter(QObject * watched, QEvent * event)
+{
+    Q_UNUSED(watched);
+    if (event->type() == QEvent::Paint && !m_capturing)
+    {
+        m_painted = true;
+        // right after the paint is done
+        if (m_pending)
+        {
+            m_pending = false;
+            QMetaObject::invokeMethod(this, "capture", Qt::QueuedConnection);
+        }
+    }
+    return false;
+}
+
+QRect ScreenRecorder::tileRect(const Frame & frame, int tile) const
+{
+    int columns = (frame.size.width() + frame.tile.width() - 1) / frame.tile.width();
+    QRect rect(QPoint((tile % columns) * frame.tile.width(), (tile / columns) * frame.tile.height()), frame.tile);
+    return rect & QRect(QPoint(0, 0), frame.size);
+}
+
+void ScreenRecorder::capture()
+{
+    // held again since the paint, the next one brings the finished screen
+    if (!m_enabled || !m_term->updatesEnabled())
+    {
+        m_pending = m_enabled;
+        return;
+    }
+
+    m_capturing = true;
+    QImage image = m_display->grab().toImage().convertToFormat(QImage::Format_RGB32);
+    m_capturing = false;
+    if (image.isNull())
+        return;
+
+    QFontMetrics metrics(m_term->getTerminalFont());
+    Frame frame;
+    frame.time = QDateTime::currentMSecsSinceEpoch();
+    frame.size = image.size();
+    frame.tile = QSize(qMax(1, metrics.width(QLatin1Char('M'))), qMax(1, metrics.height()));
+    frame.key = m_frames.isEmpty() || m_sinceKey >= KeyFrameInterval
+                || m_frames.last().size != frame.size || m_frames.last().tile != frame.tile;
+
+    int columns = (frame.size.width() + frame.tile.width() - 1) / frame.tile.width();
+    int rows = (frame.size.height() + frame.tile.height() - 1) / frame.tile.height();
+    QVector<uint> hashes(columns * rows);
+    QByteArray data;
+    int changed = 0;
+    for (int tile = 0; tile < hashes.count(); ++tile)
+    {
+        QRect rect = tileRect(frame, tile);
+        uint hash = 0;
+        for (int y = rect.top(); y <= rect.bottom(); ++y)
+            hash = qHashBits(image.constScanLine(y) + rect.left() * 4, rect.width() * 4, hash);
+        hashes[tile] = hash;
+
+        if (frame.key || hash == m_tileHashes.at(tile))
+            continue;
+        ++changed;
+        quint32 index = tile;
+        data.append(reinterpret_cast<const char *>(&index), sizeof(index));
+        for (int y = rect.top(); y <= rect.bottom(); ++y)
+            data.append(reinterpret_cast<const char *>(image.constScanLine(y)) + rect.left() * 4, rect.width() * 4);
+    }
+
+    if (!frame.key && !changed)
+        return;
+    if (!frame.key && changed > hashes.count() / 2)
+        frame.key = true;
+    if (frame.key)
+        data = QByteArray(reinterpret_cast<const char *>(image.constBits()), image.byteCount());
+
+    frame.data = qCompress(data, 1);
+    m_tileHashes = hashes;
+    m_sinceKey = frame.key ? 0 : m_sinceKey + 1;
+    m_frames.append(frame);
+    m_bytes += frame.data.size();
+    dropOldFrames();
+    emit framesChanged();
+}
+
+void ScreenRecorder::applyFrame(QImage & image, const Frame & frame) const
+{
+    QByteArray data = qUncompress(frame.data);
+    if (frame.key)
+    {
+        image = QImage(frame.size, QImage::Format_RGB32);
+        memcpy(image.bits(), data.constData(), qMin(data.size(), image.byteCount()));
+        return;
+    }
+
+    const char * p = data.constData();
+    const char * end = p + data.size();
+    while (end - p >= int(sizeof(quint32)))
+    {
+        quint32 index;
+        memcpy(&index, p, sizeof(index));
+        p += sizeof(index);
+        QRect rect = tileRect(frame, index);
+        for (int y = rect.top(); y <= rect.bottom() && end - p >= rect.width() * 4; ++y)
+        {
+            memcpy(image.scanLine(y) + rect.left() * 4, p, rect.width() * 4);
+            p += rect.width() * 4;
+        }
+    }
+}
+
+QImage ScreenRecorder::frame(int frame) const
+{
+    int key = frame;
+    while (key > 0 && !m_frames.at(key).key)
+        --key;
+
+    QImage image;
+    for (int i = key; i <= frame; ++i)
+        applyFrame(image, m_frames.at(i));
+    return image;
+}
+
+void ScreenRecorder::dropOldFrames()
+{
+    // deltas are useless without their key frame, drop them together
+    while (m_bytes > m_budget && !m_frames.isEmpty())
+    {
+        do
+        {
+            m_bytes -= m_frames.first().data.size();
+            m_frames.removeFirst();
+        }
+        while (!m_frames.isEmpty() && !m_frames.first().key);
+    }
+
+    if (m_frames.isEmpty())
+    {
+        m_tileHashes.clear();
+        m_sinceKey = 0;
+    }
+}
@@ -0,0 +1,114 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef SCREENRECORDER_H
+#define SCREENRECORDER_H
+
+#include <QObject>
+#include <QImage>
+#include <QList>
+#include <QVector>
+#include <QTimer>
+
+class TermWidgetImpl;
+
+
+/*! \brief Keeps the recent screens of full screen programs.
+
+Programs on the alternate screen (top, watch, editors) never reach the
+history, so while one runs the terminal is captured a few times a second
+after it printed something. A capture is only taken once the character
+grid has painted the output itself, never while the FrameScheduler holds
+the painting, so it shows what was on the screen. The captures are split into tiles of one
+character cell. A key frame stores all of them, the frames in between only
+the tiles which changed since the previous capture, so an idle top costs
+next to nothing. Frames are compressed and kept within a fixed budget,
+the oldest group of a key frame and its deltas goes first.
+
+qtermwidget doesn't expose the screen cells, so the tiles are taken from
+the rendered terminal instead. That render is an extra paint of the grid,
+other paint observers skip it, see isCapturing().
+*/
+class ScreenRecorder : public QObject
+{
+    Q_OBJECT
+
+    public:
+        enum { KeyFrameInterval = 50 };
+
+        explicit ScreenRecorder(TermWidgetImpl * term);
+
+        void setEnabled(bool enabled);
+        bool isEnabled() const { return m_enabled; }
+        //! Memory for the frames in bytes
+        void setBudget(qint64 bytes);
+
+        int frameCount() const { return m_frames.count(); }
+        //! Capture time of \a frame in ms since the epoch
+        qint64 frameTime(int frame) const { return m_frames.at(frame).time; }
+        //! The screen as it was at \a frame
+        QImage frame(int frame) const;
+        qint64 memoryUsage() const { return m_bytes; }
+        void clear();
+        //! True while a capture renders the terminal, its paints are not real ones
+        static bool isCapturing() { return m_capturing; }
+
+    signals:
+        void framesChanged();
+
+    protected:
+        bool eventFilter(QObject * watched, QEvent * event);
+
+    private slots:
+        void outputReceived();
+        void captureDue();
+        void capture();
+
+    private:
+        struct Frame
+        {
+            qint64 time;
+            bool key;
+            QSize size;
+            QSize tile;
+            // key frames: all pixels, deltas: (tile index, tile pixels) pairs
+            QByteArray data;
+        };
+
+        QRect tileRect(const Frame & frame, int tile) const;
+        void applyFrame(QImage & image, const Frame & frame) const;
+        void dropOldFrames();
+
+        TermWidgetImpl * m_term;
+        QWidget * m_display;
+        bool m_enabled;
+        // the output since the timer started has been painted
+        bool m_painted;
+        // the timer is due, waiting for a paint of the output
+        bool m_pending;
+        qint64 m_budget;
+        qint64 m_bytes;
+        QList<Frame> m_frames;
+        int m_sinceKey;
+        QVector<uint> m_tileHashes;
+        QTimer m_timer;
+
+        static bool m_capturing;
+};
+
+#endif
@@ -0,0 +1,232 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QApplication>
+#include <QDateTime>
+
+#include "searchdialog.h"
+#include "tabwidget.h"
+#include "termwidgetholder.h"
+#include "properties.h"
+
+// request ids are shared by the dialogs of all windows
+static int SearchRequestCount = 0;
+
+
+template <class T>
+static T * ancestor(QWidget * widget)
+{
+    for (; widget; widget = widget->parentWidget())
+    {
+        if (T * found = qobject_cast<T*>(widget))
+            return found;
+    }
+    return 0;
+}
+
+
+SearchDialog::SearchDialog(QWidget * parent)
+    : QDialog(parent),
+      m_request(0)
+{
+    setupUi(this);
+
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(150);
+
+    connect(searchEdit, SIGNAL(textChanged(QString)), &m_timer, SLOT(start()));
+    connect(searchEdit, SIGNAL(returnPressed()), this, SLOT(startSearch()));
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(startSearch()));
+    connect(regexCheckBox, SIGNAL(toggled(bool)), this, SLOT(startSearch()));
+    connect(caseCheckBox, SIGNAL(toggled(bool)), this, SLOT(startSearch()));
+    connect(stopButton, SIGNAL(clicked()), this, SLOT(stopSearch()));
+    connect(&m_regexSearch, SIGNAL(hitsFound(QList<SearchHit>)), this, SLOT(regexHitsFound(QList<SearchHit>)));
+    connect(&m_regexSearch, SIGNAL(finished()), this, SLOT(regexFinished()));
+    connect(resultsTree, SIGNAL(itemActivated(QTreeWidgetItem*,int)), this, SLOT(activateHit(QTreeWidgetItem*)));
+    connect(SearchIndex::Instance(), SIGNAL(searchFinished(int,QList<SearchHit>)),
+            this, SLOT(searchFinished(int,QList<SearchHit>)));
+}
+
+QList<TermWidgetImpl*> SearchDialog::terminals()
+{
+    QList<TermWidgetImpl*> terms;
+    foreach (QWidget * window, QApplication::topLevelWidgets())
+    {
+        foreach (TermWidgetImpl * term, window->findChildren<TermWidgetImpl*>())
+        {
+            if (!term->isScratch())
+                terms.append(term);
+        }
+    }
+    return terms;
+}
+
+TermWidgetImpl * SearchDialog::terminal(uint id)
+{
+    foreach (TermWidgetImpl * term, terminals())
+    {
+        if (term->terminalId() == id)
+            return term;
+    }
+    return 0;
+}
+
+QString SearchDialog::terminalLabel(TermWidgetImpl * term)
+{
+    TermWidgetHolder * holder = ancestor<TermWidgetHolder>(term);
+    TabWidget * tabs = ancestor<TabWidget>(holder);
+    if (!holder || !tabs)
+        return term->title();
+
+    QString label = tabs->tabText(tabs->indexOf(holder));
+    QList<TermWidgetImpl*> panes = holder->findChildren<TermWidgetImpl*>();
+    if (panes.count() > 1)
+        label += QString(" [%1]").arg(panes.indexOf(term) + 1);
+    return label;
+}
+
+void SearchDialog::startSearch()
+{
+    m_timer.stop();
+    m_regexSearch.cancel();
+    m_request = ++SearchRequestCount;
+    m_elapsed.start();
+    resultsTree->clear();
+
+    SearchSnapshots snapshots;
+    foreach (TermWidgetImpl * term, terminals())
+        snapshots.insert(term->terminalId(), term->history()->snapshot());
+
+    if (!regexCheckBox->isChecked())
+    {
+        QMetaObject::invokeMethod(SearchIndex::Instance(), "search", Qt::QueuedConnection,
+                                  Q_ARG(int, m_request),
+                                  Q_ARG(QByteArray, searchEdit->text().toUtf8()),
+                                  Q_ARG(bool, caseCheckBox->isChecked()),
+                                  Q_ARG(SearchSnapshots, snapshots));
+        return;
+    }
+
+    if (searchEdit->text().isEmpty())
+    {
+        updateStatus(false);
+        return;
+    }
+    if (!m_regexSearch.start(snapshots, searchEdit->text(), caseCheckBox->isChecked()))
+    {
+        statusLabel->setText(m_regexSearch.errorString());
+        return;
+    }
+    updateStatus(m_regexSearch.isRunning());
+}
+
+void SearchDialog::searchFinished(int request, const QList<SearchHit> & hits)
+{
+    if (request != m_request)
+        return;
+
+    addHits(hits);
+    updateStatus(false);
+}
+
+void SearchDialog::regexHitsFound(const QList<SearchHit> & hits)
+{
+    addHits(hits);
+    updateStatus(true);
+}
+
+void SearchDialog::regexFinished()
+{
+    updateStatus(false);
+}
+
+void SearchDialog::stopSearch()
+{
+    m_regexSearch.cancel();
+    updateStatus(false);
+}
+
+void SearchDialog::hideEvent(QHideEvent * event)
+{
+    m_regexSearch.cancel();
+    QDialog::hideEvent(event);
+}
+
+void SearchDialog::addHits(const QList<SearchHit> & hits)
+{
+    QHash<uint, QString> labels;
+    foreach (TermWidgetImpl * term, terminals())
+        labels.insert(term->terminalId(), terminalLabel(term));
+
+    QList<QTreeWidgetItem*> items;
+    foreach (const SearchHit & hit, hits)
+    {
+        // the terminal might be gone by now
+        if (!labels.contains(hit.terminal))
+            continue;
+
+        QTreeWidgetItem * item = new QTreeWidgetItem;
+        item->setText(0, labels.value(hit.terminal));
+        if (hit.time)
+            item->setText(1, QDateTime::fromMSecsSinceEpoch(hit.time).toString("yyyy-MM-dd hh:mm:ss.zzz"));
+        item->setText(2, QString::fromUtf8(hit.text).trimmed());
+        item->setData(0, Qt::UserRole, hit.terminal);
+        item->setData(1, Qt::UserRole, hit.line);
+        items.append(item);
+    }
+    resultsTree->addTopLevelItems(items);
+    if (resultsTree->topLevelItemCount() == items.count())
+    {
+        resultsTree->resizeColumnToContents(0);
+        resultsTree->resizeColumnToContents(1);
+    }
+}
+
+void SearchDialog::updateStatus(bool running)
+{
+    stopButton->setEnabled(running);
+    QString hits = tr("%n hit(s)", "", resultsTree->topLevelItemCount());
+    if (running)
+        statusLabel->setText(tr("Searching... %1").arg(hits));
+    else if (!resultsTree->topLevelItemCount() && !Properties::Instance()->historySearch)
+        statusLabel->setText(tr("No hits, the output is only kept for search when enabled in the preferences"));
+    else
+        statusLabel->setText(tr("%1 in %2 ms").arg(hits).arg(m_elapsed.elapsed()));
+}
+
+void SearchDialog::activateHit(QTreeWidgetItem * item)
+{
+    TermWidgetImpl * term = terminal(item->data(0, Qt::UserRole).toUInt());
+    if (!term)
+    {
+        statusLabel->setText(tr("The terminal has been closed"));
+        return;
+    }
+
+    TermWidgetHolder * holder = ancestor<TermWidgetHolder>(term);
+    TabWidget * tabs = ancestor<TabWidget>(holder);
+    if (holder && tabs)
+        tabs->setCurrentWidget(holder);
+
+    QWidget * window = term->window();
+    window->show();
+    window->raise();
+    window->activateWindow();
+    term->setFocus();
+    term->scrollToHistoryLine(item->data(1, Qt::UserRole).toLongLong());
+}
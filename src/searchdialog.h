@@ -0,0 +1,71 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef SEARCHDIALOG_H
+#define SEARCHDIALOG_H
+
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "ui_searchdialog.h"
+#include "searchindex.h"
+#include "historysearch.h"
+
+class TermWidgetImpl;
+
+
+/*! \brief Search the history of all terminals of all windows.
+
+Plain queries run on the SearchIndex thread as you type, regular
+expressions are matched by HistorySearch and their hits are listed while
+the search goes on. Activating a hit switches to its window, tab and
+terminal and scrolls to the line.
+*/
+class SearchDialog : public QDialog, private Ui::SearchDialog
+{
+    Q_OBJECT
+
+    public:
+        explicit SearchDialog(QWidget * parent = 0);
+
+    private slots:
+        void startSearch();
+        void searchFinished(int request, const QList<SearchHit> & hits);
+        void regexHitsFound(const QList<SearchHit> & hits);
+        void regexFinished();
+        void stopSearch();
+        void activateHit(QTreeWidgetItem * item);
+
+    protected:
+        void hideEvent(QHideEvent * event);
+
+    private:
+        void addHits(const QList<SearchHit> & hits);
+        void updateStatus(bool running);
+
+        HistorySearch m_regexSearch;
+        QTimer m_timer;
+        QElapsedTimer m_elapsed;
+        int m_request;
+
+        static QList<TermWidgetImpl*> terminals();
+        static TermWidgetImpl * terminal(uint id);
+        static QString terminalLabel(TermWidgetImpl * term);
+};
+
+#endif
@@ -0,0 +1,232 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QCoreApplication>
+#include <QThread>
+
+#include <algorithm>
+
+#include "searchindex.h"
+
+
+SearchIndex * SearchIndex::m_instance = 0;
+QThread * SearchIndex::m_thread = 0;
+
+
+static bool isWordChar(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool hitOrder(const SearchHit & a, const SearchHit & b)
+{
+    if (a.score != b.score)
+        return a.score > b.score;
+    return a.line > b.line;
+}
+
+
+SearchIndex * SearchIndex::Instance()
+{
+    if (!m_instance)
+    {
+        qRegisterMetaType<QList<QByteArray> >("QList<QByteArray>");
+        qRegisterMetaType<TermHistorySnapshot>("TermHistorySnapshot");
+        qRegisterMetaType<SearchSnapshots>("SearchSnapshots");
+        qRegisterMetaType<QList<SearchHit> >("QList<SearchHit>");
+
+        m_thread = new QThread;
+        m_thread->setObjectName("SearchIndex");
+        m_instance = new SearchIndex;
+        m_instance->moveToThread(m_thread);
+        m_thread->start(QThread::LowPriority);
+        qAddPostRoutine(stop);
+    }
+    return m_instance;
+}
+
+SearchIndex::SearchIndex()
+    : QObject(0)
+{
+}
+
+void SearchIndex::stop()
+{
+    m_thread->quit();
+    m_thread->wait();
+    delete m_instance;
+    m_instance = 0;
+    delete m_thread;
+    m_thread = 0;
+}
+
+void SearchIndex::addTrigrams(const QByteArray & text, QSet<quint32> & trigrams)
+{
+    const uchar * data = reinterpret_cast<const uchar *>(text.constData());
+    for (int i = 0; i + 2 < text.size(); ++i)
+        trigrams.insert((data[i] << 16) | (data[i + 1] << 8) | data[i + 2]);
+}
+
+void SearchIndex::sealOpen(Terminal & term)
+{
+    if (term.open >= 0 && !term.openTrigrams.isEmpty())
+    {
+        QVector<quint32> trigrams;
+        trigrams.reserve(term.openTrigrams.count());
+        foreach (quint32 trigram, term.openTrigrams)
+            trigrams.append(trigram);
+        std::sort(trigrams.begin(), trigrams.end());
+        term.blocks.insert(term.open, trigrams);
+    }
+    term.open = -1;
+    term.openTrigrams.clear();
+}
+
+void SearchIndex::update(Terminal & term, const TermHistorySnapshot & history)
+{
+    // forget the groups which have been dropped from the history
+    qint64 keep = history.firstLine() / BlockLines;
+    while (!term.blocks.isEmpty() && term.blocks.firstKey() < keep)
+        term.blocks.erase(term.blocks.begin());
+    if (term.open < keep)
+        sealOpen(term);
+
+    // the lines added since the last search
+    qint64 from = qMax(term.indexed, history.firstLine());
+    for (int block = history.blockForLine(from); from < history.endLine() && block < history.blockCount(); ++block)
+    {
+        QList<QByteArray> lines = history.blockLines(block);
+        qint64 first = history.blockFirstLine(block);
+        for (qint64 n = from; n < first + lines.count(); ++n)
+        {
+            qint64 group = n / BlockLines;
+            if (group != term.open)
+            {
+                sealOpen(term);
+                term.open = group;
+            }
+            addTrigrams(TermHistory::stripAttributes(lines.at(n - first)).toLower(), term.openTrigrams);
+        }
+        from = first + lines.count();
+    }
+    term.indexed = qMax(term.indexed, history.endLine());
+
+    while (term.blocks.count() > MaxGroups)
+    {
+        term.unindexed = (term.blocks.firstKey() + 1) * BlockLines;
+        term.blocks.erase(term.blocks.begin());
+    }
+}
+
+void SearchIndex::removeTerminal(uint terminal)
+{
+    m_terminals.remove(terminal);
+}
+
+void SearchIndex::search(int request, const QByteArray & text, bool caseSensitive, const SearchSnapshots & terminals)
+{
+    QList<SearchHit> hits;
+    QByteArray needle = text.toLower();
+    if (needle.isEmpty())
+    {
+        emit searchFinished(request, hits);
+        return;
+    }
+
+    QSet<quint32> trigramSet;
+    addTrigrams(needle, trigramSet);
+    QVector<quint32> trigrams;
+    foreach (quint32 trigram, trigramSet)
+        trigrams.append(trigram);
+
+    for (SearchSnapshots::const_iterator it = terminals.constBegin(); it != terminals.constEnd(); ++it)
+    {
+        const TermHistorySnapshot & history = it.value();
+        Terminal & term = m_terminals[it.key()];
+        update(term, history);
+
+        // candidate line ranges, newest first
+        QList<QPair<qint64, qint64> > ranges;
+        bool openMatches = term.open >= 0;
+        foreach (quint32 trigram, trigrams)
+            openMatches = openMatches && term.openTrigrams.contains(trigram);
+        if (openMatches)
+            ranges.append(qMakePair(term.open * BlockLines, (term.open + 1) * BlockLines));
+        QMap<qint64, QVector<quint32> >::const_iterator block = term.blocks.constEnd();
+        while (block != term.blocks.constBegin())
+        {
+            --block;
+            bool matches = true;
+            for (int i = 0; matches && i < trigrams.count(); ++i)
+                matches = std::binary_search(block.value().constBegin(), block.value().constEnd(), trigrams.at(i));
+            if (matches)
+                ranges.append(qMakePair(block.key() * BlockLines, (block.key() + 1) * BlockLines));
+        }
+        if (term.unindexed > history.firstLine())
+            ranges.append(qMakePair(history.firstLine(), term.unindexed));
+
+        // verify the candidates against the history itself
+        int cachedBlock = -1;
+        QList<QByteArray> lines;
+        QVector<qint64> times;
+        int found = 0;
+        for (int r = 0; r < ranges.count() && found < MaxHits; ++r)
+        {
+            qint64 from = qMax(ranges.at(r).first, history.firstLine());
+            qint64 to = qMin(ranges.at(r).second, history.endLine());
+            for (qint64 n = to - 1; n >= from && found < MaxHits; --n)
+            {
+                int block = history.blockForLine(n);
+                if (block != cachedBlock)
+                {
+                    lines = history.blockLines(block);
+                    times = history.blockTimes(block);
+                    cachedBlock = block;
+                }
+                int ix = int(n - history.blockFirstLine(block));
+                QByteArray line = TermHistory::stripAttributes(lines.value(ix));
+                int pos = line.toLower().indexOf(needle);
+                if (pos < 0)
+                    continue;
+                // filtered before the hits are counted, so none are lost to MaxHits
+                bool exact = line.indexOf(text) >= 0;
+                if (caseSensitive && !exact)
+                    continue;
+
+                SearchHit hit;
+                hit.terminal = it.key();
+                hit.line = n;
+                hit.time = times.value(ix);
+                hit.text = line;
+                hit.score = 1;
+                if (exact)
+                    hit.score += 2;
+                int end = pos + needle.size();
+                if ((pos == 0 || !isWordChar(line.at(pos - 1))) && (end == line.size() || !isWordChar(line.at(end))))
+                    hit.score += 1;
+                hits.append(hit);
+                ++found;
+            }
+        }
+    }
+
+    std::stable_sort(hits.begin(), hits.end(), hitOrder);
+    if (hits.count() > MaxHits)
+        hits.erase(hits.begin() + MaxHits, hits.end());
+    emit searchFinished(request, hits);
+}
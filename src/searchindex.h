@@ -0,0 +1,115 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QVector>
+#include <QMetaType>
+
+#include "termhistory.h"
+
+class QThread;
+
+
+struct SearchHit
+{
+    uint terminal;
+    qint64 line;
+    //! arrival time of the line, see TermHistory::lineTime()
+    qint64 time;
+    QByteArray text;
+    int score;
+};
+
+typedef QHash<uint, TermHistorySnapshot> SearchSnapshots;
+
+
+/*! \brief Trigram index over the history of all terminals.
+
+The index records which trigrams occur in each group of BlockLines lines.
+It is built on the first search and every search brings it up to date
+with the TermHistorySnapshots it is given, so terminals nobody searches
+cost nothing. A query only looks at the groups containing all of its
+trigrams and checks those lines against the snapshots, so the lines
+themselves are never stored twice.
+
+Groups dropped from the history are dropped from the index. Beyond
+MaxGroups per terminal (unlimited history) the oldest groups are dropped
+as well and their lines are always checked.
+
+The index lives on its own thread, all the slots are meant to be invoked
+with queued connections. The index is case insensitive for ASCII.
+*/
+class SearchIndex : public QObject
+{
+    Q_OBJECT
+
+    public:
+        enum { BlockLines = 128, MaxGroups = 4096, MaxHits = 1000 };
+
+        static SearchIndex * Instance();
+        static bool isRunning() { return m_instance; }
+
+    public slots:
+        void removeTerminal(uint terminal);
+        /*! At most MaxHits per terminal, the newest ones. The index itself is case
+            insensitive for ASCII, \a caseSensitive drops the other matches.
+         */
+        void search(int request, const QByteArray & text, bool caseSensitive, const SearchSnapshots & terminals);
+
+    signals:
+        //! \a hits are sorted by score, newest lines first
+        void searchFinished(int request, const QList<SearchHit> & hits);
+
+    private:
+        struct Terminal
+        {
+            // sealed groups, keyed by line / BlockLines, sorted trigrams
+            QMap<qint64, QVector<quint32> > blocks;
+            qint64 open;
+            QSet<quint32> openTrigrams;
+            // lines before this are indexed
+            qint64 indexed;
+            // lines before this are not in the index any more, see MaxGroups
+            qint64 unindexed;
+
+            Terminal() : open(-1), indexed(0), unindexed(0) {}
+        };
+
+        SearchIndex();
+        static void stop();
+        static void addTrigrams(const QByteArray & text, QSet<quint32> & trigrams);
+        void sealOpen(Terminal & term);
+        void update(Terminal & term, const TermHistorySnapshot & history);
+
+        QHash<uint, Terminal> m_terminals;
+
+        static SearchIndex * m_instance;
+        static QThread * m_thread;
+};
+
+Q_DECLARE_METATYPE(SearchHit)
+Q_DECLARE_METATYPE(TermHistorySnapshot)
+Q_DECLARE_METATYPE(SearchSnapshots)
+
+#endif
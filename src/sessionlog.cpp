@@ -0,0 +1,278 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QCoreApplication>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QDebug>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "sessionlog.h"
+
+
+SessionLogWriter * SessionLogWriter::m_instance = 0;
+
+
+#ifdef HAVE_ZLIB
+namespace {
+
+class CompressLogTask : public QRunnable
+{
+    public:
+        explicit CompressLogTask(const QString & fileName) : m_fileName(fileName) {}
+
+        void run()
+        {
+            QFile in(m_fileName);
+            if (!in.open(QIODevice::ReadOnly))
+                return;
+
+            QString gzName = m_fileName + ".gz";
+            gzFile out = gzopen(QFile::encodeName(gzName).constData(), "wb");
+            if (!out)
+                return;
+            QFile::setPermissions(gzName, QFile::ReadOwner | QFile::WriteOwner);
+
+            bool ok = true;
+            while (ok && !in.atEnd())
+            {
+                QByteArray chunk = in.read(256 * 1024);
+                ok = !chunk.isEmpty() && gzwrite(out, chunk.constData(), chunk.size()) == chunk.size();
+            }
+            if (gzclose(out) != Z_OK)
+                ok = false;
+
+            if (ok)
+                in.remove();
+            else
+                QFile::remove(gzName);
+        }
+
+    private:
+        QString m_fileName;
+};
+
+}
+#endif
+
+
+SessionLog::SessionLog(const QString & dir, uint terminal, qint64 maxSize, int maxAge, bool compress)
+    : m_ring(new char[RingSize]),
+      m_head(0),
+      m_tail(0),
+      m_dropped(0),
+      m_dir(dir),
+      m_terminal(terminal),
+      m_maxSize(maxSize),
+      m_maxAge(maxAge),
+      m_compress(compress),
+      m_failed(false)
+{
+    open();
+}
+
+SessionLog::~SessionLog()
+{
+    // usually on the writer thread, see SessionLogWriter::remove(); closing
+    // must not rotate, that would leave a new empty file behind
+    write(false);
+}
+
+void SessionLog::open()
+{
+    m_opened = QDateTime::currentDateTime();
+    QString name = QString("%1/qterminal-%2-%3-%4")
+                       .arg(m_dir, m_opened.toString("yyyyMMdd-HHmmss"))
+                       .arg(QCoreApplication::applicationPid())
+                       .arg(m_terminal);
+    QString fileName = name + ".log";
+    for (int i = 1; QFile::exists(fileName) || QFile::exists(fileName + ".gz"); ++i)
+        fileName = QString("%1.%2.log").arg(name).arg(i);
+
+    m_file.setFileName(fileName);
+    m_failed = false;
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qWarning() << "Cannot open session log" << fileName << m_file.errorString();
+        return;
+    }
+    // the output may well contain passwords and such
+    m_file.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+}
+
+void SessionLog::rotate()
+{
+    QString fileName = m_file.fileName();
+    m_file.close();
+#ifdef HAVE_ZLIB
+    if (m_compress)
+        QThreadPool::globalInstance()->start(new CompressLogTask(fileName));
+#endif
+    open();
+}
+
+void SessionLog::append(const QByteArray & data)
+{
+    int size = data.size();
+    int copied = push(data.constData(), size);
+    if (copied < size)
+    {
+        // the GUI thread must not wait for the disk, what doesn't fit is lost
+        m_dropped.fetchAndAddRelaxed(size - copied);
+        SessionLogWriter::Instance()->wake();
+        return;
+    }
+
+    if (m_head.load() - m_tail.loadAcquire() > RingSize / 2)
+        SessionLogWriter::Instance()->wake();
+}
+
+int SessionLog::push(const char * data, int size)
+{
+    // producer side: only this thread moves m_head
+    quint64 head = m_head.load();
+    quint64 tail = m_tail.loadAcquire();
+    size = qMin(size, int(RingSize - (head - tail)));
+    if (size <= 0)
+        return 0;
+
+    int pos = int(head % RingSize);
+    int first = qMin(size, int(RingSize) - pos);
+    memcpy(m_ring.data() + pos, data, first);
+    memcpy(m_ring.data(), data + first, size - first);
+    m_head.storeRelease(head + size);
+    return size;
+}
+
+void SessionLog::writeFile(const char * data, qint64 size)
+{
+    if (size > 0 && m_file.write(data, size) != size)
+        reportError();
+}
+
+void SessionLog::reportError()
+{
+    // a full disk would fail every write from now on
+    if (m_failed)
+        return;
+    m_failed = true;
+    qWarning() << "Cannot write session log" << m_file.fileName() << m_file.errorString();
+}
+
+void SessionLog::write(bool mayRotate)
+{
+    // consumer side: only this thread moves m_tail
+    quint64 tail = m_tail.load();
+    quint64 head = m_head.loadAcquire();
+    quint64 dropped = m_dropped.fetchAndStoreRelaxed(0);
+    if (head == tail && !dropped)
+        return;
+
+    if (m_file.isOpen())
+    {
+        int pos = int(tail % RingSize);
+        int size = int(head - tail);
+        int first = qMin(size, int(RingSize) - pos);
+        writeFile(m_ring.data() + pos, first);
+        writeFile(m_ring.data(), size - first);
+        if (dropped)
+        {
+            QByteArray note = QString("\r\n[qterminal: %1 bytes of output have not been logged]\r\n").arg(dropped).toLatin1();
+            writeFile(note.constData(), note.size());
+        }
+        if (!m_file.flush())
+            reportError();
+    }
+    m_tail.storeRelease(head);
+
+    if (!mayRotate || !m_file.isOpen())
+        return;
+    if ((m_maxSize > 0 && m_file.size() >= m_maxSize)
+        || (m_maxAge > 0 && m_opened.secsTo(QDateTime::currentDateTime()) >= m_maxAge))
+        rotate();
+}
+
+
+SessionLogWriter * SessionLogWriter::Instance()
+{
+    if (!m_instance)
+    {
+        m_instance = new SessionLogWriter;
+        m_instance->start(QThread::LowPriority);
+        qAddPostRoutine(stop);
+    }
+    return m_instance;
+}
+
+SessionLogWriter::SessionLogWriter()
+    : QThread(0),
+      m_stop(false)
+{
+    setObjectName("SessionLogWriter");
+}
+
+void SessionLogWriter::stop()
+{
+    m_instance->m_mutex.lock();
+    m_instance->m_stop = true;
+    m_instance->m_mutex.unlock();
+    m_instance->wake();
+    m_instance->wait();
+    delete m_instance;
+    m_instance = 0;
+}
+
+void SessionLogWriter::add(const QSharedPointer<SessionLog> & log)
+{
+    QMutexLocker locker(&m_mutex);
+    m_logs.append(log);
+}
+
+void SessionLogWriter::remove(const QSharedPointer<SessionLog> & log)
+{
+    QMutexLocker locker(&m_mutex);
+    m_logs.removeAll(log);
+    m_closing.append(log);
+    wake();
+}
+
+void SessionLogWriter::run()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_stop)
+    {
+        m_wake.wait(&m_mutex, FlushInterval);
+        QList<QSharedPointer<SessionLog> > logs = m_logs;
+        QList<QSharedPointer<SessionLog> > closing = m_closing;
+        m_closing.clear();
+        locker.unlock();
+
+        foreach (const QSharedPointer<SessionLog> & log, logs)
+            log->flush();
+        logs.clear();
+        // the final flush is in the destructor, here once the terminal is gone
+        closing.clear();
+
+        locker.relock();
+    }
+    m_logs.clear();
+    m_closing.clear();
+}
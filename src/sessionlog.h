@@ -0,0 +1,125 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef SESSIONLOG_H
+#define SESSIONLOG_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInteger>
+#include <QScopedArrayPointer>
+#include <QSharedPointer>
+#include <QDateTime>
+#include <QFile>
+
+
+/*! \brief Raw output log of one terminal.
+
+append() is called with the pty output on the GUI thread and only copies
+the data into a lock-free single producer / single consumer ring. The
+SessionLogWriter thread drains the ring to disk, so a slow disk never
+stalls the terminal. A chunk that doesn't fit into the ring goes in as far
+as there is room, only the rest is dropped and a note about it is written
+to the log. Write errors are reported once.
+
+The log is rotated by the writer thread when it reaches the configured
+size or age. Rotated files are gzipped on the thread pool when qterminal
+was built with zlib.
+*/
+class SessionLog
+{
+    public:
+        enum { RingSize = 256 * 1024 };
+
+        /*! Starts logging to a new file in \a dir, see fileName().
+            The file is rotated after \a maxSize bytes or \a maxAge seconds,
+            zero disables the limit.
+         */
+        SessionLog(const QString & dir, uint terminal, qint64 maxSize, int maxAge, bool compress);
+        ~SessionLog();
+
+        QString fileName() const { return m_file.fileName(); }
+
+        void append(const QByteArray & data);
+        //! Write the buffered data out, called by the writer thread only
+        void flush() { write(true); }
+
+    private:
+        void write(bool mayRotate);
+        //! Copy as much of \a data as fits into the ring, returns the bytes copied
+        int push(const char * data, int size);
+        void writeFile(const char * data, qint64 size);
+        void reportError();
+        void open();
+        void rotate();
+
+        QScopedArrayPointer<char> m_ring;
+        QAtomicInteger<quint64> m_head;
+        QAtomicInteger<quint64> m_tail;
+        QAtomicInteger<quint64> m_dropped;
+
+        QString m_dir;
+        uint m_terminal;
+        qint64 m_maxSize;
+        int m_maxAge;
+        bool m_compress;
+        QFile m_file;
+        QDateTime m_opened;
+        // a write to the current file has failed, reported once
+        bool m_failed;
+};
+
+
+/*! \brief The thread writing all the SessionLogs.
+
+One thread serves every terminal. It wakes up periodically and whenever a
+ring gets half full.
+*/
+class SessionLogWriter : public QThread
+{
+    Q_OBJECT
+
+    public:
+        enum { FlushInterval = 250 };
+
+        static SessionLogWriter * Instance();
+
+        void add(const QSharedPointer<SessionLog> & log);
+        //! The writer flushes the log a last time and lets it go
+        void remove(const QSharedPointer<SessionLog> & log);
+        void wake() { m_wake.wakeOne(); }
+
+    protected:
+        void run();
+
+    private:
+        SessionLogWriter();
+        static void stop();
+
+        QMutex m_mutex;
+        QWaitCondition m_wake;
+        QList<QSharedPointer<SessionLog> > m_logs;
+        // removed, the last reference is dropped on the writer thread
+        QList<QSharedPointer<SessionLog> > m_closing;
+        bool m_stop;
+
+        static SessionLogWriter * m_instance;
+};
+
+#endif
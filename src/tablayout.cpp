@@ -0,0 +1,128 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QDataStream>
+#include <QSplitter>
+
+#include "tablayout.h"
+#include "tabwidget.h"
+#include "termwidgetholder.h"
+
+
+TabLayout TabLayout::capture(TermWidgetHolder * holder, const QString & customName,
+                             QList<TermWidget*> & terms)
+{
+    TabLayout layout;
+    QSplitter * root = holder ? holder->findChild<QSplitter*>(QString(), Qt::FindDirectChildrenOnly) : 0;
+    if (!root)
+        return layout;
+    layout.customName = customName;
+    layout.root = layout.captureNode(root, terms);
+    return layout;
+}
+
+TabLayout::Node TabLayout::captureNode(QWidget * widget, QList<TermWidget*> & terms)
+{
+    Node node;
+    node.orientation = Qt::Horizontal;
+
+    if (TermWidget * term = qobject_cast<TermWidget*>(widget))
+    {
+        node.pane = terms.count();
+        terms.append(term);
+        directories.append(term->impl()->workingDirectory());
+    }
+    else if (QSplitter * splitter = qobject_cast<QSplitter*>(widget))
+    {
+        node.orientation = splitter->orientation();
+        for (int i = 0; i < splitter->count(); ++i)
+        {
+            Node child = captureNode(splitter->widget(i), terms);
+            // splitters left empty by collapsing their terminals
+            if (firstPane(child) >= 0)
+                node.children.append(child);
+        }
+    }
+    return node;
+}
+
+int TabLayout::firstPane(const Node & node)
+{
+    if (node.pane >= 0 || node.children.isEmpty())
+        return node.pane;
+    return firstPane(node.children.first());
+}
+
+int TabLayout::restore(TabWidget * tabs, const QStringList & files, const QString & shell) const
+{
+    int pane = firstPane(root);
+    if (pane < 0)
+        return -1;
+
+    int ix = tabs->addNewTab(shell, directories.value(pane), files.value(pane));
+    TermWidgetHolder * holder = tabs->terminalHolder();
+    restoreNode(holder, root, holder->findChildren<TermWidget*>().first(), files);
+    if (!customName.isEmpty())
+        tabs->setCustomTabName(ix, customName);
+    return ix;
+}
+
+void TabLayout::restoreNode(TermWidgetHolder * holder, const Node & node, TermWidget * term,
+                            const QStringList & files) const
+{
+    if (node.pane >= 0)
+        return;
+
+    // the first child takes the place of term, the others are split off
+    // one after another; more than two children end up nested
+    QList<TermWidget*> terms;
+    terms.append(term);
+    for (int i = 1; i < node.children.count(); ++i)
+    {
+        int pane = firstPane(node.children.at(i));
+        terms.append(holder->split(terms.last(), Qt::Orientation(node.orientation),
+                                   directories.value(pane), files.value(pane)));
+    }
+
+    for (int i = 0; i < node.children.count(); ++i)
+        restoreNode(holder, node.children.at(i), terms.at(i), files);
+}
+
+QDataStream & operator<<(QDataStream & stream, const TabLayout::Node & node)
+{
+    return stream << qint32(node.orientation) << qint32(node.pane) << node.children;
+}
+
+QDataStream & operator>>(QDataStream & stream, TabLayout::Node & node)
+{
+    qint32 orientation, pane;
+    stream >> orientation >> pane >> node.children;
+    node.orientation = orientation;
+    node.pane = pane;
+    return stream;
+}
+
+QDataStream & operator<<(QDataStream & stream, const TabLayout & layout)
+{
+    return stream << layout.customName << layout.root << layout.directories;
+}
+
+QDataStream & operator>>(QDataStream & stream, TabLayout & layout)
+{
+    return stream >> layout.customName >> layout.root >> layout.directories;
+}
@@ -0,0 +1,78 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef TABLAYOUT_H
+#define TABLAYOUT_H
+
+#include <QList>
+#include <QStringList>
+
+class QDataStream;
+class QWidget;
+class TabWidget;
+class TermWidget;
+class TermWidgetHolder;
+
+
+/*! \brief The split layout of a tab with the directories of its terminals.
+
+Used to bring a tab back later, by ClosedTabs and across restarts by
+HistoryStore. The terminals are numbered (panes) in the order they are
+found in the layout, each of them can get a history file to load.
+*/
+class TabLayout
+{
+    public:
+        // a splitter, or a terminal (pane >= 0) of the layout
+        struct Node
+        {
+            Node() : orientation(0), pane(-1) {}
+
+            int orientation;
+            int pane;
+            QList<Node> children;
+        };
+
+        //! The layout of \a holder, its terminals go to \a terms in pane order
+        static TabLayout capture(TermWidgetHolder * holder, const QString & customName,
+                                 QList<TermWidget*> & terms);
+
+        bool isEmpty() const { return directories.isEmpty(); }
+        int paneCount() const { return directories.count(); }
+        /*! Recreate the tab in \a tabs, pane i loads the history in \a files[i]
+            and the first terminal runs \a shell. Returns the tab index.
+         */
+        int restore(TabWidget * tabs, const QStringList & files, const QString & shell = QString()) const;
+
+        QString customName;
+        Node root;
+        QStringList directories;
+
+    private:
+        Node captureNode(QWidget * widget, QList<TermWidget*> & terms);
+        void restoreNode(TermWidgetHolder * holder, const Node & node, TermWidget * term,
+                         const QStringList & files) const;
+        static int firstPane(const Node & node);
+};
+
+QDataStream & operator<<(QDataStream & stream, const TabLayout::Node & node);
+QDataStream & operator>>(QDataStream & stream, TabLayout::Node & node);
+QDataStream & operator<<(QDataStream & stream, const TabLayout & layout);
+QDataStream & operator>>(QDataStream & stream, TabLayout & layout);
+
+#endif
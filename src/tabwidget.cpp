@@ -25,14 +25,16 @@
 #include "tabwidget.h"
 #include "config.h"
 #include "properties.h"
+#include "closedtabs.h"
 
 
 #define TAB_INDEX_PROPERTY "tab_index"
 #define TAB_CUSTOM_NAME_PROPERTY "custom_name"
 
 
-TabWidget::TabWidget(QWidget* parent) : QTabWidget(parent), tabNumerator(0)
+TabWidget::TabWidget(QWidget* parent) : QTabWidget(parent), tabNumerator(0), m_closing(false)
 {
+    m_closedTabs = new ClosedTabs(this);
     setFocusPolicy(Qt::NoFocus);
 
     /* On Mac OS X this will look similar to
@@ -64,21 +66,25 @@ void TabWidget::setWorkDirectory(const QString& dir)
     this->work_dir = dir;
 }
 
-int TabWidget::addNewTab(const QString & shell_program)
+int TabWidget::addNewTab(const QString & shell_program, const QString & wdir, const QString & restoreFile)
 {
     tabNumerator++;
     QString label = QString(tr("Shell No. %1")).arg(tabNumerator);
 
     TermWidgetHolder *ch = terminalHolder();
     QString cwd(work_dir);
-    if (Properties::Instance()->useCWD && ch)
+    if (!wdir.isEmpty())
+    {
+        cwd = wdir;
+    }
+    else if (Properties::Instance()->useCWD && ch)
     {
         cwd = ch->currentTerminal()->impl()->workingDirectory();
         if (cwd.isEmpty())
             cwd = work_dir;
     }
 
-    TermWidgetHolder *console = new TermWidgetHolder(cwd, shell_program, this);
+    TermWidgetHolder *console = new TermWidgetHolder(cwd, shell_program, this, restoreFile);
     console->setWindowTitle(label);
     connect(console, SIGNAL(finished()), SLOT(removeFinished()));
     connect(console, SIGNAL(lastTerminalClosed()), this, SLOT(removeFinished()));
@@ -179,13 +185,23 @@ void TabWidget::renameSession(int index)
                                         tr("New tab name:"), QLineEdit::Normal,
                                         QString(), &ok);
     if(ok && !text.isEmpty())
-    {
-        setTabIcon(index, QIcon{});
-        setTabText(index, text);
-        widget(index)->setProperty(TAB_CUSTOM_NAME_PROPERTY, true);
-        if (currentIndex() == index)
-            emit currentTitleChanged(index);
-    }
+        setCustomTabName(index, text);
+}
+
+QString TabWidget::customTabName(int index) const
+{
+    if (!widget(index) || !widget(index)->property(TAB_CUSTOM_NAME_PROPERTY).toBool())
+        return QString();
+    return tabText(index);
+}
+
+void TabWidget::setCustomTabName(int index, const QString & name)
+{
+    setTabIcon(index, QIcon{});
+    setTabText(index, name);
+    widget(index)->setProperty(TAB_CUSTOM_NAME_PROPERTY, true);
+    if (currentIndex() == index)
+        emit currentTitleChanged(index);
 }
 
 void TabWidget::renameCurrentSession()
@@ -256,6 +272,8 @@ void TabWidget::removeTab(int index)
     setUpdatesEnabled(false);
 
     QWidget * w = widget(index);
+    if (!m_closing)
+        m_closedTabs->add(qobject_cast<TermWidgetHolder*>(w), customTabName(index));
     QTabWidget::removeTab(index);
     w->deleteLater();
 
@@ -276,6 +294,19 @@ void TabWidget::removeTab(int index)
     showHideTabBar();
 }
 
+void TabWidget::removeAllTabs()
+{
+    m_closing = true;
+    for (int i = count(); i > 0; --i)
+        removeTab(i - 1);
+    m_closing = false;
+}
+
+int TabWidget::reopenClosedTab()
+{
+    return m_closedTabs->reopen();
+}
+
 void TabWidget::removeCurrentTab()
 {
     // question disabled due user requests. Yes I agree it was anoying.
@@ -412,6 +443,18 @@ void TabWidget::clearActiveTerminal()
     reinterpret_cast<TermWidgetHolder*>(widget(currentIndex()))->clearActiveTerminal();
 }
 
+void TabWidget::trimBackgroundHistory()
+{
+    int floor = Properties::Instance()->memoryPressureHistoryFloor;
+    for (int i = 0; i < count(); ++i)
+    {
+        // leave alone what the user is looking at
+        if (i == currentIndex() && isVisible())
+            continue;
+        static_cast<TermWidgetHolder*>(widget(i))->trimHistory(floor);
+    }
+}
+
 void TabWidget::saveSession()
 {
     int ix = currentIndex();
@@ -27,6 +27,7 @@
 class TermWidgetHolder;
 class QAction;
 class QActionGroup;
+class ClosedTabs;
 
 
 class TabWidget : public QTabWidget
@@ -39,9 +40,18 @@ public:
 
     void showHideTabBar();
 
+    //! The name given by the user, empty if the tab follows the terminal title
+    QString customTabName(int index) const;
+    void setCustomTabName(int index, const QString & name);
+
 public slots:
-    int addNewTab(const QString& shell_program = QString());
+    //! \a restoreFile is a saved history for the terminal of the new tab
+    int addNewTab(const QString& shell_program = QString(), const QString & wdir = QString(),
+                  const QString & restoreFile = QString());
+    int reopenClosedTab();
     void removeTab(int);
+    //! Remove the tabs when the window closes, they are not kept for reopening
+    void removeAllTabs();
     void removeCurrentTab();
     int switchToRight();
     int switchToLeft();
@@ -71,6 +81,7 @@ public slots:
     void propertiesChanged();
 
     void clearActiveTerminal();
+    void trimBackgroundHistory();
 
     void saveSession();
     void loadSession();
@@ -101,6 +112,8 @@ protected slots:
 private:
     int tabNumerator;
     QString work_dir;
+    ClosedTabs * m_closedTabs;
+    bool m_closing;
     /* re-order naming of the tabs then removeCurrentTab() */
     void renameTabsAfterRemove();
 };
@@ -0,0 +1,1158 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QByteArrayList>
+#include <QCoreApplication>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "termhistory.h"
+#include "historydir.h"
+
+// longer lines are split, a terminal would wrap them anyway
+#define MAX_LINE_BYTES 16384
+#define MAX_SEQUENCE_BYTES 256
+// decompressed blocks kept around for scrolling back and forth
+#define CACHED_BLOCKS 8
+// output stopping this long ends a run, see setRetention()
+#define RUN_PAUSE_MS 1000
+// parsed output applied per event loop turn, well below a frame
+#define APPLY_BUDGET_NS 4000000
+// saved histories, see save()
+#define HISTORY_FILE_MAGIC 0x51544831
+#define HISTORY_FILE_VERSION 2
+// elided output is handed to the writer thread in chunks of this size
+#define ELIDED_WRITE_BYTES 65536
+
+
+static void appendVarint(QByteArray & out, quint64 value)
+{
+    while (value >= 0x80)
+    {
+        out += char(value | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+
+/*! Lets the compression tasks reach the history only while it exists */
+struct TermHistoryGuard
+{
+    QMutex mutex;
+    TermHistory * history;
+};
+
+/*! Unlinked file with compressed blocks of unlimited history */
+struct TermHistorySpill
+{
+    int fd;
+    qint64 size;
+
+    TermHistorySpill() : fd(-1), size(0) {}
+    ~TermHistorySpill()
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+};
+
+
+/*! File an elided output goes to, created on the writer thread */
+struct TermHistoryElided
+{
+    QString fileName;
+    int fd;
+    bool failed;
+
+    TermHistoryElided() : fd(-1), failed(false) {}
+    ~TermHistoryElided()
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+};
+
+
+class CompressTask : public QRunnable
+{
+    public:
+        CompressTask(const QSharedPointer<TermHistoryGuard> & guard, qint64 first, const QByteArray & raw)
+            : m_guard(guard),
+              m_first(first),
+              m_raw(raw)
+        {
+        }
+
+        void run()
+        {
+            // level 1: we want it cheap, text compresses well anyway
+            QByteArray data = qCompress(m_raw, 1);
+
+            // the queued call is discarded if the history is deleted meanwhile
+            QMutexLocker locker(&m_guard->mutex);
+            if (m_guard->history)
+                QMetaObject::invokeMethod(m_guard->history, "blockCompressed", Qt::QueuedConnection,
+                                          Q_ARG(qlonglong, m_first), Q_ARG(QByteArray, data));
+        }
+
+    private:
+        QSharedPointer<TermHistoryGuard> m_guard;
+        qint64 m_first;
+        QByteArray m_raw;
+};
+
+
+class WriteElidedTask : public QRunnable
+{
+    public:
+        WriteElidedTask(const QSharedPointer<TermHistoryElided> & elided, const QByteArray & data)
+            : m_elided(elided),
+              m_data(data)
+        {
+        }
+
+        void run()
+        {
+            // the tasks run one by one, nothing else touches the fd
+            TermHistoryElided * elided = m_elided.data();
+            if (elided->fd < 0 && !elided->failed)
+            {
+                // not mkpath(), HistoryDir may be gone already at exit
+                QByteArray path = QFile::encodeName(elided->fileName);
+                QString dir = QFileInfo(elided->fileName).path();
+                if (QDir(dir).exists() || QDir().mkdir(dir))
+                    elided->fd = ::open(path.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+                elided->failed = elided->fd < 0;
+            }
+            if (elided->fd < 0)
+                return;
+
+            if (::write(elided->fd, m_data.constData(), m_data.size()) != m_data.size())
+            {
+                qWarning() << "Cannot save the elided output to" << elided->fileName;
+                ::close(elided->fd);
+                elided->fd = -1;
+                elided->failed = true;
+            }
+        }
+
+    private:
+        QSharedPointer<TermHistoryElided> m_elided;
+        QByteArray m_data;
+};
+
+
+/*! Splits the raw output into lines, see TermHistory::appendOutput() */
+class TermHistoryParser
+{
+    public:
+        explicit TermHistoryParser(bool altScreen)
+            : m_state(Ground),
+              m_textMark(0),
+              m_pendingCR(false),
+              m_altScreen(altScreen)
+        {
+        }
+
+        void parse(const QByteArray & data, TermHistoryParsed & out);
+
+    private:
+        enum State { Ground, Escape, EscapeArg, Csi, Osc, OscEscape, String, StringEscape };
+
+        void appendText(TermHistoryParsed & out, const char * text, int len);
+        void finishLine(TermHistoryParsed & out);
+        void handleCsi(TermHistoryParsed & out);
+        void handleOsc(TermHistoryParsed & out);
+
+        State m_state;
+        QByteArray m_seq;
+        QByteArray m_current;
+        int m_textMark;
+        bool m_pendingCR;
+        bool m_altScreen;
+};
+
+
+class ParseBatchTask : public QRunnable
+{
+    public:
+        ParseBatchTask(QObject * dispatcher, const TermHistoryBatch & batch)
+            : m_dispatcher(dispatcher),
+              m_batch(batch)
+        {
+        }
+
+        void run()
+        {
+            for (int i = 0; i < m_batch.count(); ++i)
+            {
+                TermHistoryJob & job = m_batch[i];
+                job.parser->parse(job.data, job.parsed);
+                job.data.clear();
+            }
+            // the dispatcher waits for this task before it goes away
+            QMetaObject::invokeMethod(m_dispatcher, "deliver", Qt::QueuedConnection,
+                                      Q_ARG(TermHistoryBatch, m_batch));
+        }
+
+    private:
+        QObject * m_dispatcher;
+        TermHistoryBatch m_batch;
+};
+
+
+void TermHistoryParser::parse(const QByteArray & data, TermHistoryParsed & out)
+{
+    const char * p = data.constData();
+    const char * stop = p + data.size();
+
+    while (p < stop)
+    {
+        uchar c = *p;
+        switch (m_state)
+        {
+        case Ground:
+            if (c >= 0x20 && c != 0x7f)
+            {
+                // printable text incl. UTF-8 goes in one go
+                const char * start = p;
+                while (p < stop && uchar(*p) >= 0x20 && uchar(*p) != 0x7f)
+                    ++p;
+                appendText(out, start, p - start);
+                continue;
+            }
+            switch (c)
+            {
+            case '\n':
+                finishLine(out);
+                break;
+            case '\r':
+                m_pendingCR = true;
+                break;
+            case '\t':
+                appendText(out, p, 1);
+                break;
+            case '\b':
+                if (!m_altScreen && m_current.size() > m_textMark)
+                {
+                    int i = m_current.size() - 1;
+                    while (i > m_textMark && (uchar(m_current.at(i)) & 0xc0) == 0x80)
+                        --i;
+                    m_current.truncate(i);
+                }
+                break;
+            case 0x1b:
+                m_state = Escape;
+                break;
+            default:
+                break;
+            }
+            break;
+
+        case Escape:
+            switch (c)
+            {
+            case '[':
+                m_seq.clear();
+                m_state = Csi;
+                break;
+            case ']':
+                m_seq.clear();
+                m_state = Osc;
+                break;
+            case 'P': case 'X': case '^': case '_':
+                m_state = String;
+                break;
+            case '(': case ')': case '*': case '+': case '#': case '%': case ' ':
+                m_state = EscapeArg;
+                break;
+            default:
+                m_state = Ground;
+                break;
+            }
+            break;
+
+        case EscapeArg:
+            m_state = Ground;
+            break;
+
+        case Csi:
+            if (c >= 0x40 && c <= 0x7e)
+            {
+                m_seq += char(c);
+                handleCsi(out);
+                m_state = Ground;
+            }
+            else if (c == 0x1b)
+            {
+                m_state = Escape;
+            }
+            else if (c >= 0x20 && m_seq.size() < MAX_SEQUENCE_BYTES)
+            {
+                m_seq += char(c);
+            }
+            break;
+
+        case Osc:
+            if (c == 0x07)
+            {
+                handleOsc(out);
+                m_state = Ground;
+            }
+            else if (c == 0x1b)
+            {
+                m_state = OscEscape;
+            }
+            else if (m_seq.size() < MAX_SEQUENCE_BYTES)
+            {
+                m_seq += char(c);
+            }
+            break;
+
+        case OscEscape:
+            // ST is ESC \, anything else starts a new sequence
+            if (c == '\\')
+            {
+                handleOsc(out);
+                m_state = Ground;
+            }
+            else
+            {
+                m_state = Escape;
+                continue;
+            }
+            break;
+
+        case String:
+            if (c == 0x1b)
+                m_state = StringEscape;
+            break;
+
+        case StringEscape:
+            m_state = c == '\\' ? Ground : String;
+            break;
+        }
+        ++p;
+    }
+
+    out.altScreen = m_altScreen;
+}
+
+void TermHistoryParser::appendText(TermHistoryParsed & out, const char * text, int len)
+{
+    if (m_altScreen)
+        return;
+
+    if (m_pendingCR)
+    {
+        // carriage return without a newline: the line is being redrawn
+        // (prompts, progress bars) - keep just the final state
+        m_pendingCR = false;
+        m_current.clear();
+        m_textMark = 0;
+    }
+
+    m_current.append(text, len);
+    if (m_current.size() >= MAX_LINE_BYTES)
+        finishLine(out);
+}
+
+void TermHistoryParser::finishLine(TermHistoryParsed & out)
+{
+    if (m_altScreen)
+        return;
+
+    m_pendingCR = false;
+    out.lines.append(m_current);
+    m_current.clear();
+    m_textMark = 0;
+}
+
+void TermHistoryParser::handleCsi(TermHistoryParsed & out)
+{
+    char final = m_seq.at(m_seq.size() - 1);
+    bool priv = m_seq.size() > 1 && (m_seq.at(0) == '?' || m_seq.at(0) == '>' || m_seq.at(0) == '=');
+
+    if (final == 'm' && !priv)
+    {
+        // SGR is the only sequence worth keeping in the history
+        appendText(out, "\x1b[", 2);
+        appendText(out, m_seq.constData(), m_seq.size());
+        if (!m_altScreen)
+            m_textMark = m_current.size();
+    }
+    else if ((final == 'h' || final == 'l') && m_seq.startsWith('?'))
+    {
+        foreach (const QByteArray & mode, m_seq.mid(1, m_seq.size() - 2).split(';'))
+        {
+            int m = mode.toInt();
+            if (m == 47 || m == 1047 || m == 1049)
+                m_altScreen = final == 'h';
+        }
+    }
+}
+
+void TermHistoryParser::handleOsc(TermHistoryParsed & out)
+{
+    // only the shell integration marks are of interest, see TermHistoryCommand
+    if (m_altScreen || !m_seq.startsWith("133;") || m_seq.size() < 5)
+        return;
+    out.marks.append(qMakePair(out.lines.count(), m_seq));
+}
+
+
+QList<QByteArray> TermHistoryBlock::decode(const TermHistorySpill * spill) const
+{
+    QByteArray raw;
+    if (offset >= 0)
+    {
+        QByteArray buf(size, Qt::Uninitialized);
+        if (spill && ::pread(spill->fd, buf.data(), size, offset) == size)
+            raw = qUncompress(buf);
+    }
+    else
+    {
+        raw = compressed ? qUncompress(data) : data;
+    }
+
+    QList<QByteArray> result = raw.split('\n');
+    if (result.count() != lines)
+    {
+        // keep the line numbering intact even if the data is lost
+        qWarning() << "TermHistory: cannot decode block at line" << first;
+        result.clear();
+        for (int i = 0; i < lines; ++i)
+            result.append(QByteArray());
+    }
+    return result;
+}
+
+
+int TermHistorySnapshot::blockCount() const
+{
+    return m_blocks.count() + (m_tail.isEmpty() ? 0 : 1);
+}
+
+qint64 TermHistorySnapshot::blockFirstLine(int block) const
+{
+    if (block < m_blocks.count())
+        return m_blocks.at(block).first;
+    return m_end - m_tail.count();
+}
+
+QList<QByteArray> TermHistorySnapshot::blockLines(int block) const
+{
+    if (block < m_blocks.count())
+        return m_blocks.at(block).decode(m_spill.data());
+    return m_tail;
+}
+
+QVector<qint64> TermHistorySnapshot::blockTimes(int block) const
+{
+    if (block < m_blocks.count())
+        return TermHistory::decodeTimes(m_blocks.at(block).stamps, m_blocks.at(block).lines);
+    return TermHistory::decodeTimes(m_tailStamps, m_tail.count());
+}
+
+int TermHistorySnapshot::blockForLine(qint64 line) const
+{
+    if (m_blocks.isEmpty() || line >= m_end - m_tail.count())
+        return m_blocks.count();
+
+    int lo = 0;
+    int hi = m_blocks.count() - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (m_blocks.at(mid).first <= line)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+QByteArray TermHistorySnapshot::compressedBlock(int block) const
+{
+    if (block >= m_blocks.count())
+        return qCompress(m_tail.join('\n'), 1);
+
+    const TermHistoryBlock & b = m_blocks.at(block);
+    if (b.offset >= 0)
+    {
+        QByteArray buf(b.size, Qt::Uninitialized);
+        if (m_spill && ::pread(m_spill->fd, buf.data(), b.size, b.offset) == b.size)
+            return buf;
+        return QByteArray();
+    }
+    return b.compressed ? b.data : qCompress(b.data, 1);
+}
+
+TermHistory::TermHistory(QObject * parent)
+    : QObject(parent),
+      m_maxLines(1000),
+      m_firstLine(0),
+      m_lineCount(0),
+      m_lastStamp(0),
+      m_now(QDateTime::currentMSecsSinceEpoch()),
+      m_cache(CACHED_BLOCKS),
+      m_guard(new TermHistoryGuard),
+      m_retainMax(0),
+      m_retainKeep(0),
+      m_retainSpill(false),
+      m_runLines(0),
+      m_lastLineTime(0),
+      m_elided(0),
+      m_runTimer(this),
+      m_parser(new TermHistoryParser(false)),
+      m_generation(0),
+      m_priority(1),
+      m_altScreen(false)
+{
+    m_guard->history = this;
+
+    // a run of output without shell integration marks ends with a pause
+    m_runTimer.setSingleShot(true);
+    m_runTimer.setInterval(RUN_PAUSE_MS);
+    connect(&m_runTimer, SIGNAL(timeout()), this, SLOT(flushRun()));
+}
+
+TermHistory::~TermHistory()
+{
+    QMutexLocker locker(&m_guard->mutex);
+    m_guard->history = 0;
+}
+
+void TermHistory::setMaxLines(int lines)
+{
+    m_maxLines = lines;
+    dropOldBlocks();
+}
+
+void TermHistory::setRetention(int maxLines, int keepLines, bool spill)
+{
+    if (maxLines != m_retainMax || keepLines != m_retainKeep)
+        flushRun();
+    m_retainMax = maxLines > 0 ? qMax(maxLines, 2 * keepLines) : 0;
+    m_retainKeep = keepLines;
+    m_retainSpill = spill;
+}
+
+QByteArray TermHistory::line(qint64 n) const
+{
+    if (n < m_firstLine || n >= endLine())
+        return QByteArray();
+
+    qint64 tailFirst = endLine() - m_tail.count();
+    if (n >= tailFirst)
+        return m_tail.at(n - tailFirst);
+
+    const TermHistoryBlock & block = m_blocks.at(blockIndex(n));
+    QList<QByteArray> * cached = m_cache.object(block.first);
+    if (cached)
+        return cached->value(n - block.first);
+
+    QList<QByteArray> lines = block.decode(m_spill.data());
+    QByteArray result = lines.value(n - block.first);
+    m_cache.insert(block.first, new QList<QByteArray>(lines));
+    return result;
+}
+
+qint64 TermHistory::lineTime(qint64 n) const
+{
+    if (n < m_firstLine || n >= endLine())
+        return 0;
+
+    qint64 tailFirst = endLine() - m_tail.count();
+    if (n >= tailFirst)
+        return decodeTimes(m_tailStamps, m_tail.count()).value(n - tailFirst);
+
+    const TermHistoryBlock & block = m_blocks.at(blockIndex(n));
+    return decodeTimes(block.stamps, block.lines).value(n - block.first);
+}
+
+QVector<qint64> TermHistory::decodeTimes(const QByteArray & stamps, int lines)
+{
+    // the first value is absolute, the others are deltas to the previous line
+    QVector<qint64> times(lines, 0);
+    const uchar * p = reinterpret_cast<const uchar *>(stamps.constData());
+    const uchar * end = p + stamps.size();
+    qint64 time = 0;
+    for (int i = 0; i < lines && p < end; ++i)
+    {
+        quint64 value = 0;
+        int shift = 0;
+        while (p < end && (*p & 0x80))
+        {
+            value |= quint64(*p++ & 0x7f) << shift;
+            shift += 7;
+        }
+        if (p < end)
+            value |= quint64(*p++) << shift;
+        time += value;
+        times[i] = time;
+    }
+    return times;
+}
+
+TermHistorySnapshot TermHistory::snapshot() const
+{
+    TermHistorySnapshot s;
+    s.m_first = m_firstLine;
+    s.m_end = endLine();
+    s.m_blocks = m_blocks;
+    s.m_tail = m_tail;
+    s.m_tailStamps = m_tailStamps;
+    s.m_spill = m_spill;
+    return s;
+}
+
+qint64 TermHistory::memoryUsage() const
+{
+    qint64 size = 0;
+    foreach (const TermHistoryBlock & block, m_blocks)
+        size += block.data.capacity() + block.stamps.capacity();
+    size += m_tailStamps.capacity();
+    foreach (const QByteArray & line, m_tail)
+        size += line.capacity();
+    return size;
+}
+
+void TermHistory::compact()
+{
+    m_cache.clear();
+}
+
+void TermHistory::clear()
+{
+    // line numbers keep growing, stale compression results are ignored
+    m_firstLine = endLine();
+    m_lineCount = 0;
+    m_blocks.clear();
+    m_tail.clear();
+    m_tailStamps.clear();
+    m_cache.clear();
+    m_commands.clear();
+    m_held.clear();
+    m_heldTimes.clear();
+    m_elided = 0;
+    m_runLines = 0;
+    m_lastLineTime = 0;
+    m_elidedFile.clear();
+    m_elidedData.clear();
+    m_spill.clear();
+    // output still being parsed belongs to the cleared history
+    m_parser.reset(new TermHistoryParser(m_altScreen));
+    ++m_generation;
+}
+
+QByteArray TermHistory::stripAttributes(const QByteArray & line)
+{
+    if (line.indexOf('\x1b') < 0)
+        return line;
+
+    QByteArray out;
+    out.reserve(line.size());
+    int i = 0;
+    while (i < line.size())
+    {
+        if (line.at(i) == '\x1b' && i + 1 < line.size() && line.at(i + 1) == '[')
+        {
+            i += 2;
+            while (i < line.size() && (line.at(i) < 0x40 || line.at(i) > 0x7e))
+                ++i;
+            ++i;
+            continue;
+        }
+        out += line.at(i++);
+    }
+    return out;
+}
+
+bool TermHistory::save(const TermHistorySnapshot & history, const QString & fileName)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    file.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    int blocks = history.blockCount();
+    out << quint32(HISTORY_FILE_MAGIC) << quint32(HISTORY_FILE_VERSION) << qint32(blocks);
+    for (int i = 0; i < blocks; ++i)
+    {
+        bool tail = i >= history.m_blocks.count();
+        out << qint32(tail ? history.m_tail.count() : history.m_blocks.at(i).lines)
+            << history.compressedBlock(i)
+            << (tail ? history.m_tailStamps : history.m_blocks.at(i).stamps);
+    }
+
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+bool TermHistory::load(const QString & fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 magic, version;
+    qint32 blocks;
+    in >> magic >> version >> blocks;
+    // version 1 had no time stamps
+    if (in.status() != QDataStream::Ok || magic != HISTORY_FILE_MAGIC || version < 1 || version > HISTORY_FILE_VERSION)
+        return false;
+
+    clear();
+    for (int i = 0; i < blocks; ++i)
+    {
+        qint32 lines;
+        QByteArray data;
+        QByteArray stamps;
+        in >> lines >> data;
+        if (version >= 2)
+            in >> stamps;
+        if (in.status() != QDataStream::Ok)
+            break;
+        if (lines <= 0)
+            continue;
+
+        // decompressed only when somebody asks for the lines
+        TermHistoryBlock block;
+        block.first = endLine();
+        block.lines = lines;
+        block.data = data;
+        block.compressed = true;
+        block.stamps = stamps;
+        m_blocks.append(block);
+        m_lineCount += lines;
+        if (m_maxLines < 0)
+            spillBlock(m_blocks.last());
+    }
+    dropOldBlocks();
+    return true;
+}
+
+void TermHistory::appendOutput(const QByteArray & data)
+{
+    TermHistoryDispatcher::Instance()->append(m_guard, m_parser, m_generation, data);
+}
+
+void TermHistory::applyParsed(const TermHistoryParsed & parsed)
+{
+    if (parsed.generation != m_generation)
+        return;
+
+    qint64 end = endLine();
+    m_now = parsed.time;
+    int line = 0;
+    for (int i = 0; i < parsed.marks.count(); ++i)
+    {
+        for (; line < parsed.marks.at(i).first; ++line)
+            addLine(parsed.lines.at(line));
+        handleOsc(parsed.marks.at(i).second);
+    }
+    for (; line < parsed.lines.count(); ++line)
+        addLine(parsed.lines.at(line));
+
+    m_altScreen = parsed.altScreen;
+
+    if (!m_held.isEmpty())
+        m_runTimer.start();
+
+    if (endLine() > end)
+        emit linesAdded(end, endLine() - end);
+}
+
+void TermHistory::addLine(const QByteArray & line)
+{
+    // a pause ends the run even if nothing is held yet, otherwise the first
+    // lines of a long output could be some earlier output
+    if (m_now - m_lastLineTime >= RUN_PAUSE_MS)
+        endRun();
+    m_lastLineTime = m_now;
+
+    if (m_retainMax > 0 && ++m_runLines > m_retainKeep)
+        holdLine(line);
+    else
+        storeLine(line, m_now);
+}
+
+void TermHistory::storeLine(const QByteArray & line, qint64 time)
+{
+    // the clock may go back, the deltas must not
+    qint64 stamp = qMax(time, m_lastStamp);
+    appendVarint(m_tailStamps, m_tail.isEmpty() ? stamp : stamp - m_lastStamp);
+    m_lastStamp = stamp;
+    m_tail.append(line);
+    ++m_lineCount;
+
+    if (m_tail.count() >= BlockLines)
+        sealBlock();
+}
+
+void TermHistory::holdLine(const QByteArray & line)
+{
+    m_held.append(line);
+    m_heldTimes.append(m_now);
+
+    // once the run is known to be too long only its end is held
+    while (m_held.count() > (m_elided ? m_retainKeep : m_retainMax - m_retainKeep))
+    {
+        elideLine(m_held.takeFirst());
+        m_heldTimes.removeFirst();
+    }
+}
+
+void TermHistory::elideLine(const QByteArray & line)
+{
+    if (!m_elided++ && m_retainSpill)
+    {
+        // the writer thread creates the file, the name must be unique up front
+        static int outputs = 0;
+        QString dir = HistoryDir::path();
+        if (!dir.isEmpty())
+        {
+            m_elidedFile = QSharedPointer<TermHistoryElided>(new TermHistoryElided);
+            m_elidedFile->fileName = QString("%1/elided/output-%2-%3.txt").arg(dir).arg(m_now).arg(++outputs);
+        }
+    }
+
+    if (m_elidedFile)
+    {
+        m_elidedData += stripAttributes(line);
+        m_elidedData += '\n';
+        if (m_elidedData.size() >= ELIDED_WRITE_BYTES)
+        {
+            TermHistoryDispatcher::Instance()->writeElided(m_elidedFile, m_elidedData);
+            m_elidedData.clear();
+        }
+    }
+}
+
+void TermHistory::endRun()
+{
+    m_runLines = 0;
+    m_runTimer.stop();
+    if (m_held.isEmpty())
+        return;
+
+    if (m_elided)
+    {
+        // the file goes away with HistoryDir, so it's not named in the marker
+        // which may outlive it in a saved history, see elidedFile()
+        QByteArray marker = "\x1b[2m[" + QByteArray::number(m_elided) + " lines elided]\x1b[0m";
+        if (m_elidedFile)
+        {
+            TermHistoryDispatcher::Instance()->writeElided(m_elidedFile, m_elidedData);
+            m_elidedData.clear();
+            m_elidedFileName = m_elidedFile->fileName;
+            m_elidedFile.clear();
+        }
+        storeLine(marker, m_heldTimes.first());
+        m_elided = 0;
+    }
+
+    for (int i = 0; i < m_held.count(); ++i)
+        storeLine(m_held.at(i), m_heldTimes.at(i));
+    m_held.clear();
+    m_heldTimes.clear();
+}
+
+void TermHistory::flushRun()
+{
+    qint64 end = endLine();
+    endRun();
+    if (endLine() > end)
+        emit linesAdded(end, endLine() - end);
+}
+
+void TermHistory::handleOsc(const QByteArray & seq)
+{
+    char mark = seq.at(4);
+    // prompt, output and end of a command all end the current run
+    if (mark != 'B')
+        endRun();
+
+    if (mark == 'A')
+    {
+        TermHistoryCommand command;
+        command.prompt = endLine();
+        m_commands.append(command);
+        return;
+    }
+
+    // marks without a prompt are ignored, there's nothing to attach them to
+    if (m_commands.isEmpty() || m_commands.last().isFinished())
+        return;
+
+    TermHistoryCommand & command = m_commands.last();
+    switch (mark)
+    {
+    case 'B':
+        command.command = endLine();
+        break;
+    case 'C':
+        command.output = endLine();
+        command.started = m_now;
+        break;
+    case 'D':
+        command.end = endLine();
+        command.finished = m_now;
+        if (seq.size() > 6 && seq.at(5) == ';')
+            command.exitCode = seq.mid(6).split(';').first().toInt();
+        break;
+    default:
+        break;
+    }
+}
+
+int TermHistory::commandAt(qint64 line) const
+{
+    QVector<TermHistoryCommand>::const_iterator it =
+            std::upper_bound(m_commands.constBegin(), m_commands.constEnd(), line,
+                             [] (qint64 l, const TermHistoryCommand & c) { return l < c.prompt; });
+    return int(it - m_commands.constBegin()) - 1;
+}
+
+int TermHistory::lastFinishedCommand() const
+{
+    // usually the newest or the one before, which is still at its prompt
+    for (int i = m_commands.count() - 1; i >= 0; --i)
+    {
+        if (m_commands.at(i).isFinished() && m_commands.at(i).output >= 0)
+            return i;
+    }
+    return -1;
+}
+
+void TermHistory::sealBlock()
+{
+    TermHistoryBlock block;
+    block.first = endLine() - m_tail.count();
+    block.lines = m_tail.count();
+    block.data = m_tail.join('\n');
+    block.stamps = m_tailStamps;
+    block.stamps.squeeze();
+    m_blocks.append(block);
+    m_tailStamps.clear();
+    m_tail.clear();
+
+    QThreadPool::globalInstance()->start(new CompressTask(m_guard, block.first, block.data));
+
+    dropOldBlocks();
+}
+
+void TermHistory::dropOldBlocks()
+{
+    if (m_maxLines < 0)
+        return;
+
+    while (!m_blocks.isEmpty() && m_lineCount - m_blocks.first().lines >= m_maxLines)
+    {
+        const TermHistoryBlock & block = m_blocks.first();
+        m_cache.remove(block.first);
+        m_firstLine += block.lines;
+        m_lineCount -= block.lines;
+        m_blocks.removeFirst();
+    }
+
+    int dropped = 0;
+    while (dropped < m_commands.count() && m_commands.at(dropped).prompt < m_firstLine
+           && (m_commands.at(dropped).isFinished() ? m_commands.at(dropped).end : endLine()) <= m_firstLine)
+        ++dropped;
+    m_commands.remove(0, dropped);
+}
+
+int TermHistory::blockIndex(qint64 line) const
+{
+    int lo = 0;
+    int hi = m_blocks.count() - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (m_blocks.at(mid).first <= line)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+void TermHistory::blockCompressed(qlonglong first, const QByteArray & data)
+{
+    if (m_blocks.isEmpty())
+        return;
+    int ix = blockIndex(first);
+    if (m_blocks.at(ix).first != first || m_blocks.at(ix).compressed)
+        return;
+
+    TermHistoryBlock & block = m_blocks[ix];
+    block.data = data;
+    block.compressed = true;
+    if (m_maxLines < 0)
+        spillBlock(block);
+}
+
+void TermHistory::spillBlock(TermHistoryBlock & block)
+{
+    if (!m_spill)
+    {
+        QString dir = HistoryDir::path();
+        if (dir.isEmpty())
+            return;
+        QByteArray path = QFile::encodeName(dir + "/spill-XXXXXX");
+        int fd = ::mkstemp(path.data());
+        if (fd < 0)
+            return;
+        ::unlink(path.constData());
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        m_spill = QSharedPointer<TermHistorySpill>(new TermHistorySpill);
+        m_spill->fd = fd;
+    }
+
+    if (::pwrite(m_spill->fd, block.data.constData(), block.data.size(), m_spill->size) != block.data.size())
+        return;
+
+    block.offset = m_spill->size;
+    block.size = block.data.size();
+    block.data.clear();
+    m_spill->size += block.size;
+}
+
+
+TermHistoryDispatcher * TermHistoryDispatcher::m_instance = 0;
+
+
+TermHistoryDispatcher * TermHistoryDispatcher::Instance()
+{
+    if (!m_instance)
+    {
+        qRegisterMetaType<TermHistoryBatch>("TermHistoryBatch");
+        m_instance = new TermHistoryDispatcher(qApp);
+    }
+    return m_instance;
+}
+
+TermHistoryDispatcher::TermHistoryDispatcher(QObject * parent)
+    : QObject(parent)
+{
+    m_pool.setMaxThreadCount(1);
+    m_writePool.setMaxThreadCount(1);
+}
+
+TermHistoryDispatcher::~TermHistoryDispatcher()
+{
+    m_pool.waitForDone();
+    m_writePool.waitForDone();
+    m_instance = 0;
+}
+
+void TermHistoryDispatcher::append(const QSharedPointer<TermHistoryGuard> & guard, const QSharedPointer<TermHistoryParser> & parser,
+                                   quint64 generation, const QByteArray & data)
+{
+    if (m_pending.isEmpty())
+        QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QHash<const TermHistoryGuard*, int>::const_iterator it = m_jobs.constFind(guard.data());
+    if (it != m_jobs.constEnd() && m_pending.at(it.value()).parsed.generation == generation)
+    {
+        TermHistoryJob & job = m_pending[it.value()];
+        job.data += data;
+        job.parsed.time = now;
+        return;
+    }
+
+    TermHistoryJob job;
+    job.guard = guard;
+    job.parser = parser;
+    job.data = data;
+    job.parsed.time = now;
+    job.parsed.generation = generation;
+    m_jobs.insert(guard.data(), m_pending.count());
+    m_pending.append(job);
+}
+
+void TermHistoryDispatcher::writeElided(const QSharedPointer<TermHistoryElided> & elided, const QByteArray & data)
+{
+    if (!data.isEmpty())
+        m_writePool.start(new WriteElidedTask(elided, data));
+}
+
+void TermHistoryDispatcher::flush()
+{
+    m_pool.start(new ParseBatchTask(this, m_pending));
+    m_pending.clear();
+    m_jobs.clear();
+}
+
+void TermHistoryDispatcher::deliver(const TermHistoryBatch & batch)
+{
+    bool idle = m_ready.isEmpty();
+    m_ready += batch;
+    if (idle)
+        applyReady();
+}
+
+static int jobPriority(const TermHistoryJob & job)
+{
+    // output of closed terminals is dropped right away
+    return job.guard->history ? job.guard->history->priority() : -1;
+}
+
+void TermHistoryDispatcher::applyReady()
+{
+    // stable: each history's output stays in order
+    std::stable_sort(m_ready.begin(), m_ready.end(),
+                     [](const TermHistoryJob & a, const TermHistoryJob & b) { return jobPriority(a) < jobPriority(b); });
+
+    QElapsedTimer clock;
+    clock.start();
+    int done = 0;
+    while (done < m_ready.count() && clock.nsecsElapsed() < APPLY_BUDGET_NS)
+    {
+        // this and the destructor clearing the guard both run on the GUI thread
+        const TermHistoryJob & job = m_ready.at(done++);
+        if (job.guard->history)
+            job.guard->history->applyParsed(job.parsed);
+    }
+    m_ready.erase(m_ready.begin(), m_ready.begin() + done);
+
+    if (!m_ready.isEmpty())
+        QMetaObject::invokeMethod(this, "applyReady", Qt::QueuedConnection);
+}
@@ -0,0 +1,352 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef TERMHISTORY_H
+#define TERMHISTORY_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QHash>
+#include <QVector>
+#include <QCache>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QThreadPool>
+
+struct TermHistoryGuard;
+struct TermHistorySpill;
+struct TermHistoryElided;
+class TermHistoryParser;
+
+
+/*! \brief One sealed group of history lines.
+
+The lines are joined with '\n'. The data is compressed in the background
+shortly after the block has been sealed; for unlimited history it is then
+moved to the spill file and only its position is kept in memory.
+
+The arrival times of the lines stay in memory in \a stamps, see
+TermHistory::lineTime().
+*/
+struct TermHistoryBlock
+{
+    qint64 first;
+    int lines;
+    QByteArray data;
+    bool compressed;
+    qint64 offset;
+    int size;
+    QByteArray stamps;
+
+    TermHistoryBlock() : first(0), lines(0), compressed(false), offset(-1), size(0) {}
+    QList<QByteArray> decode(const TermHistorySpill * spill) const;
+};
+
+
+/*! \brief One command found through the shell integration marks.
+
+Shells with integration enabled mark the prompt and the command output with
+OSC 133 (A prompt, B command line, C output, D;<exit status> done). The
+positions are history line numbers, -1 where the mark hasn't been seen,
+the output ends before \a end. The times are ms since the epoch.
+*/
+struct TermHistoryCommand
+{
+    qint64 prompt;
+    qint64 command;
+    qint64 output;
+    qint64 end;
+    qint64 started;
+    qint64 finished;
+    int exitCode;
+
+    TermHistoryCommand() : prompt(-1), command(-1), output(-1), end(-1), started(0), finished(0), exitCode(-1) {}
+    bool isFinished() const { return end >= 0; }
+    //! Run time in ms, -1 if unknown
+    qint64 duration() const { return started && finished ? finished - started : -1; }
+};
+
+
+/*! \brief What the parser made of one chunk of output.
+
+The complete \a lines, the OSC 133 payloads in \a marks together with the
+number of lines that came before them, and the mode state at the end of
+the chunk.
+*/
+struct TermHistoryParsed
+{
+    QList<QByteArray> lines;
+    QList<QPair<int, QByteArray> > marks;
+    bool altScreen;
+    qint64 time;
+    quint64 generation;
+
+    TermHistoryParsed() : altScreen(false), time(0), generation(0) {}
+};
+
+
+/*! One terminal's output waiting for, or coming back from, the parser */
+struct TermHistoryJob
+{
+    QSharedPointer<TermHistoryGuard> guard;
+    QSharedPointer<TermHistoryParser> parser;
+    QByteArray data;
+    TermHistoryParsed parsed;
+};
+typedef QList<TermHistoryJob> TermHistoryBatch;
+Q_DECLARE_METATYPE(TermHistoryBatch)
+
+
+/*! \brief Immutable copy of a TermHistory.
+
+Cheap to take (all the data is implicitly shared) and safe to read from
+any thread. The uncompressed tail is reported as the last block.
+*/
+class TermHistorySnapshot
+{
+    public:
+        TermHistorySnapshot() : m_first(0), m_end(0) {}
+
+        qint64 firstLine() const { return m_first; }
+        qint64 endLine() const { return m_end; }
+
+        int blockCount() const;
+        qint64 blockFirstLine(int block) const;
+        QList<QByteArray> blockLines(int block) const;
+        //! Index of the block holding \a line
+        int blockForLine(qint64 line) const;
+        //! The block in qCompress() format
+        QByteArray compressedBlock(int block) const;
+        //! Arrival times of the lines, see TermHistory::lineTime()
+        QVector<qint64> blockTimes(int block) const;
+
+    private:
+        friend class TermHistory;
+
+        qint64 m_first;
+        qint64 m_end;
+        QList<TermHistoryBlock> m_blocks;
+        QList<QByteArray> m_tail;
+        QByteArray m_tailStamps;
+        QSharedPointer<TermHistorySpill> m_spill;
+};
+
+
+/*! \brief Compact, line oriented copy of everything a terminal printed.
+
+TermHistory is fed with the raw pty output and keeps the lines that went
+to the primary screen (full screen programs on the alternate screen are
+skipped). SGR sequences are kept in the lines so they can be exported with
+their attributes, see stripAttributes() for the plain text.
+
+The output is split into lines on one worker thread shared by all
+terminals, so the history catches up shortly after appendOutput().
+
+The newest lines are kept as they are. Older ones are grouped into blocks
+of BlockLines lines which are compressed on the global thread pool and
+decompressed on demand into a small LRU cache. With unlimited history the
+compressed blocks go to an unlinked file in HistoryDir.
+
+Lines are addressed by absolute numbers which keep growing as output
+arrives, firstLine() advances when old lines are dropped.
+
+Every line is stamped with the time it arrived. The stamps are stored as
+varint encoded deltas, usually a byte or two per line.
+
+The OSC 133 marks of shell integration build the commands() index, sorted
+by line so commands can be looked up with a binary search.
+
+With setRetention() the middle of very long outputs (a run of lines from
+one command, or without the marks one burst of output) is replaced by a
+marker line. Past the first keepLines lines of a run the lines are held
+back until the run ends, or until it grows beyond maxLines, then only the
+last keepLines are held and the rest is dropped or spilled to a file.
+*/
+class TermHistory : public QObject
+{
+    Q_OBJECT
+
+    friend class TermHistoryDispatcher;
+
+    public:
+        enum { BlockLines = 256 };
+
+        explicit TermHistory(QObject * parent = 0);
+        ~TermHistory();
+
+        //! Number of lines to keep, -1 for unlimited
+        void setMaxLines(int lines);
+        int maxLines() const { return m_maxLines; }
+        //! True while a full screen program runs on the alternate screen
+        bool isAltScreen() const { return m_altScreen; }
+        /*! Order in which the output of busy terminals is applied, lower
+            first, see TermHistoryDispatcher
+         */
+        void setPriority(int priority) { m_priority = priority; }
+        int priority() const { return m_priority; }
+        /*! Elide the middle of outputs longer than \a maxLines and keep
+            \a keepLines at both ends, 0 turns it off. With \a spill the
+            elided lines are saved to a file, see elidedFile().
+         */
+        void setRetention(int maxLines, int keepLines, bool spill);
+        //! The file with the most recently elided output, empty if none
+        QString elidedFile() const { return m_elidedFileName; }
+
+        qint64 firstLine() const { return m_firstLine; }
+        qint64 endLine() const { return m_firstLine + m_lineCount; }
+        QByteArray line(qint64 n) const;
+        //! Arrival time of line \a n in ms since the epoch, 0 if unknown
+        qint64 lineTime(qint64 n) const;
+
+        TermHistorySnapshot snapshot() const;
+
+        //! Commands still (partly) in the history, oldest first
+        const QVector<TermHistoryCommand> & commands() const { return m_commands; }
+        //! Index of the last command whose prompt is at or above \a line, -1 if none
+        int commandAt(qint64 line) const;
+        //! Index of the newest command with a complete output, -1 if none
+        int lastFinishedCommand() const;
+
+        //! Approximate heap usage in bytes
+        qint64 memoryUsage() const;
+        //! Drop caches, used under memory pressure
+        void compact();
+        void clear();
+
+        static QByteArray stripAttributes(const QByteArray & line);
+        static QVector<qint64> decodeTimes(const QByteArray & stamps, int lines);
+
+        /*! Write \a history to \a fileName in compressed blocks, load()
+            reads them back without decompressing anything.
+         */
+        static bool save(const TermHistorySnapshot & history, const QString & fileName);
+        //! Replace the history with the one saved in \a fileName
+        bool load(const QString & fileName);
+
+    public slots:
+        void appendOutput(const QByteArray & data);
+
+    signals:
+        //! \a count complete lines starting with \a first have been added
+        void linesAdded(qint64 first, int count);
+        //! DECRQM for the private \a mode, only sent for the modes the parser tracks
+
+    private slots:
+        void applyParsed(const TermHistoryParsed & parsed);
+        void blockCompressed(qlonglong first, const QByteArray & data);
+        void flushRun();
+
+    private:
+        void addLine(const QByteArray & line);
+        void storeLine(const QByteArray & line, qint64 time);
+        void holdLine(const QByteArray & line);
+        void elideLine(const QByteArray & line);
+        void endRun();
+        void handleOsc(const QByteArray & seq);
+        void sealBlock();
+        void dropOldBlocks();
+        int blockIndex(qint64 line) const;
+        void spillBlock(TermHistoryBlock & block);
+
+        int m_maxLines;
+        qint64 m_firstLine;
+        qint64 m_lineCount;
+        QList<TermHistoryBlock> m_blocks;
+        QList<QByteArray> m_tail;
+        QByteArray m_tailStamps;
+        qint64 m_lastStamp;
+        qint64 m_now;
+        mutable QCache<qint64, QList<QByteArray> > m_cache;
+        QSharedPointer<TermHistoryGuard> m_guard;
+        QSharedPointer<TermHistorySpill> m_spill;
+        QVector<TermHistoryCommand> m_commands;
+
+        // retention of long outputs
+        int m_retainMax;
+        int m_retainKeep;
+        bool m_retainSpill;
+        int m_runLines;
+        qint64 m_lastLineTime;
+        QList<QByteArray> m_held;
+        QList<qint64> m_heldTimes;
+        qint64 m_elided;
+        QSharedPointer<TermHistoryElided> m_elidedFile;
+        QByteArray m_elidedData;
+        QString m_elidedFileName;
+        QTimer m_runTimer;
+
+        // parser state lives on the worker, results of an older
+        // generation (before clear()) are dropped
+        QSharedPointer<TermHistoryParser> m_parser;
+        quint64 m_generation;
+        int m_priority;
+        bool m_altScreen;
+};
+
+
+/*! \brief Hands the output of all terminals to the parser in batches.
+
+Every terminal reads its pty on its own and delivers the output in small
+chunks, one event each. The chunks collected until the event loop comes
+back to the dispatcher (merged per terminal) go to the parser thread as
+one task, and all the results come back in one call. With many busy
+terminals the dispatching then costs per event loop wakeup, not per
+terminal and chunk.
+
+The results are applied for a few milliseconds per event loop turn, the
+rest waits for the next turn so input and painting come in between.
+Higher priority() histories (the focused terminal) go first, otherwise
+the oldest output goes first, so busy terminals take turns.
+*/
+class TermHistoryDispatcher : public QObject
+{
+    Q_OBJECT
+
+    public:
+        static TermHistoryDispatcher * Instance();
+        ~TermHistoryDispatcher();
+
+        void append(const QSharedPointer<TermHistoryGuard> & guard, const QSharedPointer<TermHistoryParser> & parser,
+                    quint64 generation, const QByteArray & data);
+        //! Append \a data to the elided output file in the background
+        void writeElided(const QSharedPointer<TermHistoryElided> & elided, const QByteArray & data);
+
+    private slots:
+        void flush();
+        void deliver(const TermHistoryBatch & batch);
+        void applyReady();
+
+    private:
+        explicit TermHistoryDispatcher(QObject * parent = 0);
+
+        static TermHistoryDispatcher * m_instance;
+
+        // one thread for all terminals keeps every history's output in order
+        QThreadPool m_pool;
+        // and another one for the elided outputs, their chunks stay in order too
+        QThreadPool m_writePool;
+        TermHistoryBatch m_pending;
+        // the pending job of each history
+        QHash<const TermHistoryGuard*, int> m_jobs;
+        // parsed, waiting for their turn
+        TermHistoryBatch m_ready;
+};
+
+#endif
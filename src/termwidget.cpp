@@ -17,30 +17,107 @@
  ***************************************************************************/
 
 #include <QMenu>
-#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QSplitter>
 #include <QPainter>
 #include <QDesktopServices>
+#include <QScrollBar>
+#include <QDir>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QByteArrayList>
+#include <QApplication>
+#include <QClipboard>
+#include <QToolTip>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
 
 #include "termwidget.h"
 #include "config.h"
 #include "properties.h"
+#include "historydir.h"
+#include "termhistory.h"
+#include "searchindex.h"
+#include "sessionlog.h"
+#include "timegutter.h"
+#include "filterview.h"
+#include "screenrecorder.h"
+#include "framescheduler.h"
+#include "latencyprobe.h"
+#include "fontregistry.h"
 
 static int TermWidgetCount = 0;
 
+// the part of a restored history written into the terminal itself
+#define RESTORED_LINES 1000
+#define RESTORED_BYTES 16384
+// width of the highlightCurrentTerminal border
+#define FOCUS_BORDER 2
 
-TermWidgetImpl::TermWidgetImpl(const QString & wdir, const QString & shell, QWidget * parent)
-    : QTermWidget(0, parent)
+namespace {
+
+/* QTERMINAL_DEBUG_REPAINT=1 logs the region of every paint of the panes and
+ * their character grids, e.g. to check that a focus switch repaints only
+ * the borders.
+ */
+class RepaintLogger : public QObject
+{
+    public:
+        static void watch(QWidget * widget)
+        {
+            static bool enabled = qEnvironmentVariableIsSet("QTERMINAL_DEBUG_REPAINT");
+            static RepaintLogger logger;
+            if (enabled)
+                widget->installEventFilter(&logger);
+        }
+
+    protected:
+        bool eventFilter(QObject * watched, QEvent * event)
+        {
+            // the renders of the ScreenRecorder are no repaints
+            if (event->type() == QEvent::Paint && !ScreenRecorder::isCapturing())
+                qDebug() << "paint" << watched << static_cast<QPaintEvent*>(event)->region();
+            return false;
+        }
+};
+
+} // namespace
+
+
+TermWidgetImpl::TermWidgetImpl(const QString & wdir, const QString & shell, QWidget * parent,
+                               Mode mode, const QString & restoreFile)
+    : QTermWidget(0, parent),
+      m_scratch(mode == ScratchMode),
+      // not a valid history size, forces the first applyHistorySize()
+      m_historySize(-2),
+      m_focused(false),
+      m_throttled(false),
+      m_transparency(0),
+      m_fontShared(false),
+      m_skipOutput(0),
+      m_recordHistory(false)
 {
     TermWidgetCount++;
     QString name("TermWidget_%1");
     setObjectName(name.arg(TermWidgetCount));
+    m_id = TermWidgetCount;
 
     setFlowControlEnabled(FLOW_CONTROL_ENABLED);
     setFlowControlWarningEnabled(FLOW_CONTROL_WARNING_ENABLED);
 
-    propertiesChanged();
+    m_history = new TermHistory(this);
+    m_frames = new FrameScheduler(this);
+    m_latency = new LatencyProbe(this);
+    // after the probe: its event filter runs first and sees the paints the probe takes over
+    m_recorder = new ScreenRecorder(this);
+    connect(this, SIGNAL(receivedData(QString)), this, SLOT(receiveData(QString)));
+    connect(m_frames, SIGNAL(modeQueried(int,bool)), this, SLOT(reportMode(int,bool)));
+    connect(this, SIGNAL(termGetFocus()), this, SLOT(termFocusIn()));
+    connect(this, SIGNAL(termLostFocus()), this, SLOT(termFocusOut()));
 
-    setHistorySize(5000);
+    propertiesChanged();
 
     if (!wdir.isNull())
         setWorkingDirectory(wdir);
@@ -69,27 +146,47 @@ TermWidgetImpl::TermWidgetImpl(const QString & wdir, const QString & shell, QWid
 
     connect(this, SIGNAL(urlActivated(QUrl)), this, SLOT(activateUrl(const QUrl&)));
 
-    startShellProgram();
+    if (!restoreFile.isEmpty())
+        restoreHistory(restoreFile);
+
+    if (mode == ShellMode)
+        startShellProgram();
+}
+
+TermWidgetImpl::~TermWidgetImpl()
+{
+    if (m_log)
+        SessionLogWriter::Instance()->remove(m_log);
+    if (SearchIndex::isRunning())
+        QMetaObject::invokeMethod(SearchIndex::Instance(), "removeTerminal", Qt::QueuedConnection,
+                                  Q_ARG(uint, m_id));
+    if (m_fontShared && FontRegistry::isRunning())
+        FontRegistry::Instance()->release(m_font);
 }
 
 void TermWidgetImpl::propertiesChanged()
 {
     setColorScheme(Properties::Instance()->colorScheme);
-    setTerminalFont(Properties::Instance()->font);
+    setSharedFont(Properties::Instance()->font);
     setMotionAfterPasting(Properties::Instance()->m_motionAfterPaste);
 
-    if (Properties::Instance()->historyLimited)
-    {
-        setHistorySize(Properties::Instance()->historyLimitedTo);
-    }
-    else
-    {
-        // Unlimited history
-        setHistorySize(-1);
-    }
+    applyHistorySize();
+    applyHistoryRecording();
+    applySessionLog();
+    m_recorder->setEnabled(Properties::Instance()->screenRecording);
+    m_recorder->setBudget(qint64(Properties::Instance()->screenRecordingBudget) * 1024 * 1024);
+    m_frames->setFrameRates(Properties::Instance()->frameRate,
+                            Properties::Instance()->backgroundFrameRate,
+                            Properties::Instance()->throttledFrameRate);
+    m_latency->setOverlayVisible(Properties::Instance()->latencyOverlay);
 
     setKeyBindings(Properties::Instance()->emulation);
-    setTerminalOpacity(1.0 - Properties::Instance()->termTransparency/100.0);
+    // the opaque paint path is the default, leave it alone without transparency
+    if (Properties::Instance()->termTransparency != m_transparency)
+    {
+        m_transparency = Properties::Instance()->termTransparency;
+        setTerminalOpacity(1.0 - m_transparency/100.0);
+    }
 
     /* be consequent with qtermwidget.h here */
     switch(Properties::Instance()->scrollBarPos) {
@@ -121,6 +218,166 @@ void TermWidgetImpl::propertiesChanged()
     update();
 }
 
+void TermWidgetImpl::applyHistorySize()
+{
+    if (Properties::Instance()->historyLimited)
+    {
+        int lines = Properties::Instance()->historyLimitedTo;
+        m_history->setMaxLines(lines);
+        // older lines are only kept (compressed) by m_history
+        if (Properties::Instance()->historyCompressed)
+            lines = qMin(lines, Properties::Instance()->historyHotLines);
+        setHistoryLines(lines);
+    }
+    else
+    {
+        // Unlimited history
+        m_history->setMaxLines(-1);
+        setHistoryLines(-1);
+    }
+
+    m_history->setRetention(Properties::Instance()->historyElide ? Properties::Instance()->historyElideLines : 0,
+                            Properties::Instance()->historyElideKeep,
+                            Properties::Instance()->historyElideSpill);
+}
+
+void TermWidgetImpl::setHistoryLines(int lines)
+{
+    // Every setHistorySize() call converts the scroll and copies all of the
+    // history, so skip it when nothing changed (e.g. other preferences).
+    if (lines == m_historySize)
+        return;
+    m_historySize = lines;
+
+    // Unlimited history is kept by qtermwidget in QTemporaryFiles which are
+    // created in QDir::tempPath() right inside setHistorySize(). Point that
+    // to our private on-disk directory for the call and unlink the new
+    // files at once - qtermwidget only uses the open descriptors.
+    if (lines >= 0)
+    {
+        setHistorySize(lines);
+        return;
+    }
+    QStringList existing = HistoryDir::files();
+    {
+        HistoryTempPath tempPath;
+        setHistorySize(lines);
+    }
+    HistoryDir::unlinkFiles(existing);
+}
+
+void TermWidgetImpl::applyHistoryRecording()
+{
+    // Every byte of output is copied, parsed and stored for m_history, so
+    // that is done only while something uses it.
+    const Properties * p = Properties::Instance();
+    bool record = p->historySearch || p->historyPersistent || p->historyElide
+                  || (p->historyLimited && p->historyCompressed)
+                  || p->timestampGutter || p->screenRecording;
+    if (record == m_recordHistory)
+        return;
+    m_recordHistory = record;
+    // with a gap in it the history would be misleading
+    if (!record)
+        m_history->clear();
+}
+
+void TermWidgetImpl::applySessionLog()
+{
+    if (m_scratch || Properties::Instance()->sessionLogEnabled == !m_log.isNull())
+        return;
+
+    if (m_log)
+    {
+        SessionLogWriter::Instance()->remove(m_log);
+        m_log.clear();
+        return;
+    }
+
+    QString dir = Properties::Instance()->sessionLogDir;
+    if (!QDir().mkpath(dir))
+    {
+        qWarning() << "Cannot create the session log directory" << dir;
+        return;
+    }
+    QFile::setPermissions(dir, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+
+    m_log = QSharedPointer<SessionLog>(new SessionLog(dir, m_id,
+                                                      qint64(Properties::Instance()->sessionLogMaxSize) * 1024 * 1024,
+                                                      Properties::Instance()->sessionLogRotateHours * 3600,
+                                                      Properties::Instance()->sessionLogCompress));
+    SessionLogWriter::Instance()->add(m_log);
+    qDebug() << objectName() << "logging to" << m_log->fileName();
+}
+
+void TermWidgetImpl::restoreHistory(const QString & fileName)
+{
+    QDateTime saved = QFileInfo(fileName).lastModified();
+    if (!m_history->load(fileName))
+        return;
+
+    // Only the most recent lines go to the terminal, this decompresses just
+    // the last block or two. The rest stays in m_history.
+    QList<QByteArray> lines;
+    int size = 0;
+    for (qint64 n = m_history->endLine() - 1; n >= m_history->firstLine() && lines.count() < RESTORED_LINES; --n)
+    {
+        QByteArray line = m_history->line(n) + "\x1b[0m\r\n";
+        size += line.size();
+        if (size > RESTORED_BYTES)
+            break;
+        lines.prepend(line);
+    }
+    QByteArray text = lines.join();
+    text += "\x1b[2m" + tr("---- history restored from %1 ----").arg(saved.toString(Qt::DefaultLocaleShortDate)).toUtf8() + "\x1b[0m\r\n";
+
+    // The shell is not running yet, the text written to the pty slave shows
+    // up as the first output. Write it as it is (no \r\n -> \r\r\n conversion)
+    // and don't block if the pty buffer can't take it all.
+    int fd = getPtySlaveFd();
+    if (fd < 0)
+        return;
+    struct termios savedTermios;
+    bool haveTermios = ::tcgetattr(fd, &savedTermios) == 0;
+    if (haveTermios)
+    {
+        struct termios raw = savedTermios;
+        raw.c_oflag &= ~OPOST;
+        ::tcsetattr(fd, TCSANOW, &raw);
+    }
+    int flags = ::fcntl(fd, F_GETFL);
+    ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    ssize_t written = ::write(fd, text.constData(), text.size());
+
+    ::fcntl(fd, F_SETFL, flags);
+    if (haveTermios)
+        ::tcsetattr(fd, TCSANOW, &savedTermios);
+    m_skipOutput = written > 0 ? int(written) : 0;
+}
+
+void TermWidgetImpl::trimHistory(int lines)
+{
+    if (historyLinesCount() <= lines)
+        return;
+
+    // Unlimited history is kept on disk by qtermwidget, there is no memory
+    // to gain from it.
+    if (m_historySize < 0)
+        return;
+
+    qDebug() << objectName() << "trimming history from" << historyLinesCount() << "to" << lines << "lines";
+    // Resizing one HistoryScrollBuffer into another keeps the *oldest*
+    // lines. Going through the file backed scroll instead keeps the newest:
+    // converting it into a buffer of the requested size copies just the
+    // last lines, and growing that buffer back to the configured size
+    // keeps them all.
+    setHistoryLines(-1);
+    setHistoryLines(lines);
+    applyHistorySize();
+    m_history->compact();
+}
+
 void TermWidgetImpl::customContextMenuCall(const QPoint & pos)
 {
     QMenu menu;
@@ -137,14 +394,72 @@ void TermWidgetImpl::customContextMenuCall(const QPoint & pos)
 #warning TODO/FIXME: disable the action when there is only one terminal
     menu.addAction(Properties::Instance()->actions[SUB_COLLAPSE]);
     menu.addSeparator();
+    QAction * throttle = menu.addAction(tr("Throttle Output"));
+    throttle->setCheckable(true);
+    throttle->setChecked(m_throttled);
+    connect(throttle, SIGNAL(toggled(bool)), this, SLOT(setThrottled(bool)));
+    if (!m_history->elidedFile().isEmpty())
+    {
+        menu.addSeparator();
+        menu.addAction(tr("Open Elided Output"), this, SLOT(openElidedOutput()));
+    }
+    menu.addSeparator();
     menu.addAction(Properties::Instance()->actions[TOGGLE_MENU]);
     menu.addAction(Properties::Instance()->actions[PREFERENCES]);
     menu.exec(mapToGlobal(pos));
 }
 
+void TermWidgetImpl::setThrottled(bool throttled)
+{
+    m_throttled = throttled;
+    m_frames->setThrottled(throttled);
+    updatePriority();
+}
+
+void TermWidgetImpl::termFocusIn()
+{
+    m_focused = true;
+    m_frames->setFocused(true);
+    updatePriority();
+}
+
+void TermWidgetImpl::termFocusOut()
+{
+    m_focused = false;
+    m_frames->setFocused(false);
+    updatePriority();
+}
+
+void TermWidgetImpl::updatePriority()
+{
+    // see TermHistoryDispatcher, the focused terminal's output goes first
+    m_history->setPriority(m_throttled ? 2 : m_focused ? 0 : 1);
+}
+
+void TermWidgetImpl::openElidedOutput()
+{
+    QDesktopServices::openUrl(QUrl::fromLocalFile(m_history->elidedFile()));
+}
+
+void TermWidgetImpl::setSharedFont(const QFont & font)
+{
+    FontRegistry * registry = FontRegistry::Instance();
+    QFont shared = registry->acquire(font, Properties::Instance()->prewarmZoomFonts);
+    if (m_fontShared)
+        registry->release(m_font);
+    m_font = shared;
+    m_fontShared = true;
+    // After a zoom step qtermwidget has set the font already. Setting it
+    // again would only remeasure and repaint everything. QFont's operator==
+    // also compares what the registry normalizes, the key is what matters.
+    if (getTerminalFont().key() != shared.key())
+        setTerminalFont(shared);
+}
+
 void TermWidgetImpl::zoomIn()
 {
     emit QTermWidget::zoomIn();
+    setSharedFont(getTerminalFont());
 // note: do not save zoom here due the #74 Zoom reset option resets font back to Monospace
 //    Properties::Instance()->font = getTerminalFont();
 //    Properties::Instance()->saveSettings();
@@ -153,6 +468,7 @@ void TermWidgetImpl::zoomIn()
 void TermWidgetImpl::zoomOut()
 {
     emit QTermWidget::zoomOut();
+    setSharedFont(getTerminalFont());
 // note: do not save zoom here due the #74 Zoom reset option resets font back to Monospace
 //    Properties::Instance()->font = getTerminalFont();
 //    Properties::Instance()->saveSettings();
@@ -162,27 +478,190 @@ void TermWidgetImpl::zoomReset()
 {
 // note: do not save zoom here due the #74 Zoom reset option resets font back to Monospace
 //    Properties::Instance()->font = Properties::Instance()->font;
-    setTerminalFont(Properties::Instance()->font);
+    setSharedFont(Properties::Instance()->font);
 //    Properties::Instance()->saveSettings();
 }
 
+HistoryExporter * TermWidgetImpl::exportHistory(const QString & fileName, HistoryExporter::Format format, bool timestamps)
+{
+    HistoryExporter * exporter = new HistoryExporter(m_history->snapshot(), fileName, format);
+    exporter->setTimestamps(timestamps);
+    QMetaObject::invokeMethod(exporter, "start", Qt::QueuedConnection);
+    return exporter;
+}
+
+void TermWidgetImpl::receiveData(const QString & text)
+{
+    // qtermwidget hands over the raw pty bytes as latin1
+    QByteArray data = text.toLatin1();
+    m_frames->dataReceived(data);
+    if (FontRegistry::isRunning())
+        FontRegistry::Instance()->outputReceived();
+    if (m_skipOutput > 0)
+    {
+        int skip = qMin(m_skipOutput, data.size());
+        m_skipOutput -= skip;
+        data.remove(0, skip);
+        if (data.isEmpty())
+            return;
+    }
+    if (m_log)
+        m_log->append(data);
+    // parsed on a worker thread, the results come back through m_history's signals
+    if (m_recordHistory)
+        m_history->appendOutput(data);
+}
+
+void TermWidgetImpl::reportMode(int mode, bool set)
+{
+    // DECRPM, 1 is set and 2 reset. It goes out like the emulation's own
+    // replies: the display's sendStringToEmu() is connected to
+    // Emulation::sendString(), which writes to the pty. sendText() is the
+    // keyboard path, it would scroll to the bottom and count as a keypress.
+    QByteArray reply = QString("\x1b[?%1;%2$y").arg(mode).arg(set ? 1 : 2).toLatin1();
+    foreach (QWidget * child, findChildren<QWidget*>())
+    {
+        if (QByteArray(child->metaObject()->className()).endsWith("TerminalDisplay"))
+        {
+            QMetaObject::invokeMethod(child, "sendStringToEmu", Qt::DirectConnection,
+                                      Q_ARG(const char*, reply.constData()));
+            return;
+        }
+    }
+}
+
+// Lines are mapped by their distance from the end of the output. The last
+// history line is the one right above the (unfinished) cursor line, which
+// is assumed to be at the bottom of the screen.
+
+int TermWidgetImpl::historyRow(qint64 line) const
+{
+    int lines = historyLinesCount() + screenLinesCount();
+    return int(qMax<qint64>(0, lines - 1 - (m_history->endLine() - line)));
+}
+
+void TermWidgetImpl::scrollToRow(int row)
+{
+    QScrollBar * scrollBar = findChild<QScrollBar*>();
+    if (scrollBar)
+        scrollBar->setValue(qBound(0, row, scrollBar->maximum()));
+}
+
+void TermWidgetImpl::scrollToHistoryLine(qint64 line)
+{
+    int row = historyRow(line);
+    scrollToRow(row - screenLinesCount() / 2);
+    setSelectionStart(row, 0);
+    setSelectionEnd(row, screenColumnsCount() - 1);
+}
+
+qint64 TermWidgetImpl::historyLineAtRow(int row) const
+{
+    QScrollBar * scrollBar = findChild<QScrollBar*>();
+    int top = scrollBar ? scrollBar->value() : historyLinesCount();
+    int lines = historyLinesCount() + screenLinesCount();
+    return m_history->endLine() - (lines - 1 - (top + row));
+}
+
+int TermWidgetImpl::currentCommand() const
+{
+    // scrolled to the bottom: the last command, otherwise the one at the top
+    QScrollBar * scrollBar = findChild<QScrollBar*>();
+    if (!scrollBar || scrollBar->value() == scrollBar->maximum())
+        return m_history->lastFinishedCommand();
+    return m_history->commandAt(historyLineAtRow(0));
+}
+
+void TermWidgetImpl::previousPrompt()
+{
+    int ix = m_history->commandAt(historyLineAtRow(0) - 1);
+    if (ix >= 0)
+        scrollToRow(historyRow(m_history->commands().at(ix).prompt));
+}
+
+void TermWidgetImpl::nextPrompt()
+{
+    int ix = m_history->commandAt(historyLineAtRow(0)) + 1;
+    if (ix < m_history->commands().count())
+        scrollToRow(historyRow(m_history->commands().at(ix).prompt));
+}
+
+void TermWidgetImpl::selectCommandOutput()
+{
+    int ix = currentCommand();
+    if (ix < 0)
+        return;
+    const TermHistoryCommand & command = m_history->commands().at(ix);
+    qint64 end = command.isFinished() ? command.end : m_history->endLine();
+    if (command.output < 0 || end <= command.output)
+        return;
+
+    setSelectionStart(historyRow(command.output), 0);
+    setSelectionEnd(historyRow(end - 1), screenColumnsCount() - 1);
+}
+
+void TermWidgetImpl::copyLastOutput()
+{
+    int ix = m_history->lastFinishedCommand();
+    if (ix < 0)
+        return;
+    const TermHistoryCommand & command = m_history->commands().at(ix);
+
+    QByteArrayList lines;
+    for (qint64 line = qMax(command.output, m_history->firstLine()); line < command.end; ++line)
+        lines.append(TermHistory::stripAttributes(m_history->line(line)));
+    QApplication::clipboard()->setText(QString::fromUtf8(lines.join('\n')));
+}
+
+void TermWidgetImpl::showCommandDuration()
+{
+    int ix = currentCommand();
+    QString text;
+    if (ix < 0)
+    {
+        text = tr("No command marks, enable the shell integration of your shell");
+    }
+    else
+    {
+        const TermHistoryCommand & command = m_history->commands().at(ix);
+        qint64 line = command.command >= 0 ? command.command : command.prompt;
+        text = QString::fromUtf8(TermHistory::stripAttributes(m_history->line(line))).trimmed();
+        if (command.duration() >= 0)
+            text += "\n" + tr("%1 s, exit status %2").arg(command.duration() / 1000.0, 0, 'f', 3)
+                                                        .arg(command.exitCode);
+        else if (command.started)
+            text += "\n" + tr("Running since %1").arg(QDateTime::fromMSecsSinceEpoch(command.started).toString("hh:mm:ss"));
+    }
+    QToolTip::showText(mapToGlobal(rect().center()), text, this);
+}
+
 void TermWidgetImpl::activateUrl(const QUrl & url) {
     if (QApplication::keyboardModifiers() & Qt::ControlModifier) {
         QDesktopServices::openUrl(url);
     }
 }
 
-TermWidget::TermWidget(const QString & wdir, const QString & shell, QWidget * parent)
-    : QWidget(parent)
+TermWidget::TermWidget(const QString & wdir, const QString & shell, QWidget * parent,
+                       const QString & restoreFile)
+    : QWidget(parent),
+      m_focused(false)
 {
-    m_border = palette().color(QPalette::Window);
-    m_term = new TermWidgetImpl(wdir, shell, this);
+    m_term = new TermWidgetImpl(wdir, shell, this, TermWidgetImpl::ShellMode, restoreFile);
     setFocusProxy(m_term);
+    m_gutter = new TimeGutter(m_term, this);
+    // created on first use
+    m_filterView = 0;
 
-    m_layout = new QVBoxLayout;
+    m_splitter = new QSplitter(Qt::Vertical, this);
+    m_splitter->addWidget(m_term);
+    m_splitter->setCollapsible(0, false);
+
+    m_layout = new QHBoxLayout;
+    m_layout->setSpacing(0);
     setLayout(m_layout);
 
-    m_layout->addWidget(m_term);
+    m_layout->addWidget(m_gutter);
+    m_layout->addWidget(m_splitter);
 
     propertiesChanged();
 
@@ -190,37 +669,75 @@ TermWidget::TermWidget(const QString & wdir, const QString & shell, QWidget * pa
     connect(m_term, SIGNAL(termGetFocus()), this, SLOT(term_termGetFocus()));
     connect(m_term, SIGNAL(termLostFocus()), this, SLOT(term_termLostFocus()));
     connect(m_term, &QTermWidget::titleChanged, this, [this] { emit termTitleChanged(m_term->title(), m_term->icon()); });
+
+    RepaintLogger::watch(this);
+    foreach (QWidget * child, m_term->findChildren<QWidget*>())
+    {
+        if (QByteArray(child->metaObject()->className()).endsWith("TerminalDisplay"))
+            RepaintLogger::watch(child);
+    }
 }
 
 void TermWidget::propertiesChanged()
 {
     if (Properties::Instance()->highlightCurrentTerminal)
-        m_layout->setContentsMargins(2, 2, 2, 2);
+        m_layout->setContentsMargins(FOCUS_BORDER, FOCUS_BORDER, FOCUS_BORDER, FOCUS_BORDER);
     else
         m_layout->setContentsMargins(0, 0, 0, 0);
 
     m_term->propertiesChanged();
+    m_gutter->setVisible(Properties::Instance()->timestampGutter);
+    m_gutter->updateGeometry();
+}
+
+void TermWidget::toggleFilterView()
+{
+    if (!m_filterView)
+    {
+        m_filterView = new FilterView(m_term, m_splitter);
+        m_splitter->addWidget(m_filterView);
+        m_splitter->setSizes(QList<int>() << height() * 2 / 3 << height() / 3);
+        return;
+    }
+
+    m_filterView->setVisible(!m_filterView->isVisible());
+    if (!m_filterView->isVisible())
+        m_term->setFocus();
 }
 
 void TermWidget::term_termGetFocus()
 {
-    m_border = palette().color(QPalette::Highlight);
     emit termGetFocus(this);
-    update();
+    setFocused(true);
 }
 
 void TermWidget::term_termLostFocus()
 {
-    m_border = palette().color(QPalette::Window);
-    update();
+    setFocused(false);
+}
+
+void TermWidget::setFocused(bool focused)
+{
+    if (focused == m_focused)
+        return;
+    m_focused = focused;
+    // only the margin around the children, the terminal is not repainted
+    if (Properties::Instance()->highlightCurrentTerminal)
+        update(borderRegion());
 }
 
-void TermWidget::paintEvent (QPaintEvent *)
+QRegion TermWidget::borderRegion() const
 {
+    return QRegion(rect()) - QRegion(rect().adjusted(FOCUS_BORDER, FOCUS_BORDER, -FOCUS_BORDER, -FOCUS_BORDER));
+}
+
+void TermWidget::paintEvent (QPaintEvent * event)
+{
+    // unfocused panes show the parent's background through the margin
+    if (!m_focused || !Properties::Instance()->highlightCurrentTerminal)
+        return;
+
     QPainter p(this);
-    QPen pen(m_border);
-    pen.setWidth(30);
-    pen.setBrush(m_border);
-    p.setPen(pen);
-    p.drawRect(0, 0, width()-1, height()-1);
+    p.setClipRegion(event->region() & borderRegion());
+    p.fillRect(rect(), palette().color(QPalette::Highlight));
 }
@@ -22,7 +22,19 @@
 #include <qtermwidget.h>
 
 #include <QAction>
+#include <QSharedPointer>
 
+#include "historyexporter.h"
+
+class QHBoxLayout;
+class TermHistory;
+class SessionLog;
+class TimeGutter;
+class FilterView;
+class ScreenRecorder;
+class FrameScheduler;
+class LatencyProbe;
+class QSplitter;
 
 class TermWidgetImpl : public QTermWidget
 {
@@ -32,8 +44,42 @@ class TermWidgetImpl : public QTermWidget
 
     public:
 
-        TermWidgetImpl(const QString & wdir, const QString & shell=QString(), QWidget * parent=0);
+        enum Mode {
+            //! runs the shell right away
+            ShellMode,
+            //! no pty until startTerminalTeletype()
+            TeletypeMode,
+            //! a teletype for tests: no session log, no restored history, not searched
+            ScratchMode
+        };
+
+        //! \a restoreFile is a saved TermHistory to show before the shell starts
+        TermWidgetImpl(const QString & wdir, const QString & shell=QString(), QWidget * parent=0,
+                       Mode mode=ShellMode, const QString & restoreFile=QString());
+        ~TermWidgetImpl();
         void propertiesChanged();
+        //! Shed scrollback held in memory, keeping the last \a lines
+        void trimHistory(int lines);
+
+        TermHistory * history() const { return m_history; }
+        ScreenRecorder * screenRecorder() const { return m_recorder; }
+        LatencyProbe * latencyProbe() const { return m_latency; }
+        //! Unique id of the terminal in the SearchIndex
+        uint terminalId() const { return m_id; }
+        bool isScratch() const { return m_scratch; }
+        /*! Scroll \a line of the history() into view and select it.
+            The terminal wraps long lines while the history does not, so the
+            position is exact only for unwrapped output.
+         */
+        void scrollToHistoryLine(qint64 line);
+        //! The history() line shown in \a row of the screen, same caveat
+        qint64 historyLineAtRow(int row) const;
+        /*! Start writing the history to \a fileName on a worker thread.
+            The export begins once control returns to the event loop, so the
+            caller can connect to the returned exporter first.
+         */
+        HistoryExporter * exportHistory(const QString & fileName, HistoryExporter::Format format = HistoryExporter::PlainText,
+                                        bool timestamps = false);
 
     signals:
         void renameSession();
@@ -44,9 +90,55 @@ class TermWidgetImpl : public QTermWidget
         void zoomOut();
         void zoomReset();
 
+        // navigation by the shell integration marks, see TermHistoryCommand
+        void previousPrompt();
+        void nextPrompt();
+        void selectCommandOutput();
+        void copyLastOutput();
+        void showCommandDuration();
+        //! Fewer frames and the history last while output floods in
+        void setThrottled(bool throttled);
+
     private slots:
         void customContextMenuCall(const QPoint & pos);
+        void openElidedOutput();
         void activateUrl(const QUrl& url);
+        void receiveData(const QString & text);
+        void reportMode(int mode, bool set);
+        void termFocusIn();
+        void termFocusOut();
+
+    private:
+        uint m_id;
+        bool m_scratch;
+        TermHistory * m_history;
+        ScreenRecorder * m_recorder;
+        FrameScheduler * m_frames;
+        LatencyProbe * m_latency;
+        int m_historySize;
+        bool m_focused;
+        bool m_throttled;
+        // the termTransparency applied, qtermwidget starts out opaque
+        int m_transparency;
+        // from the FontRegistry, released again on change
+        QFont m_font;
+        bool m_fontShared;
+        QSharedPointer<SessionLog> m_log;
+        // echo of the restored history, not new output
+        int m_skipOutput;
+        // the output goes to m_history, see applyHistoryRecording()
+        bool m_recordHistory;
+
+        int historyRow(qint64 line) const;
+        void scrollToRow(int row);
+        int currentCommand() const;
+        void setSharedFont(const QFont & font);
+        void updatePriority();
+        void applyHistorySize();
+        void applyHistoryRecording();
+        void applySessionLog();
+        void restoreHistory(const QString & fileName);
+        void setHistoryLines(int lines);
 };
 
 
@@ -55,16 +147,22 @@ class TermWidget : public QWidget
     Q_OBJECT
 
     TermWidgetImpl * m_term;
-    QVBoxLayout * m_layout;
-    QColor m_border;
+    TimeGutter * m_gutter;
+    QSplitter * m_splitter;
+    FilterView * m_filterView;
+    QHBoxLayout * m_layout;
+    bool m_focused;
 
     public:
-        TermWidget(const QString & wdir, const QString & shell=QString(), QWidget * parent=0);
+        TermWidget(const QString & wdir, const QString & shell=QString(), QWidget * parent=0,
+                   const QString & restoreFile=QString());
 
         void propertiesChanged(); 
         QStringList availableKeyBindings() { return m_term->availableKeyBindings(); }
 
         TermWidgetImpl * impl() { return m_term; }
+        //! Show the filter view below the terminal or hide it
+        void toggleFilterView();
 
     signals:
         void finished();
@@ -81,6 +179,11 @@ class TermWidget : public QWidget
     protected:
         void paintEvent (QPaintEvent * event);
 
+    private:
+        void setFocused(bool focused);
+        //! The highlightCurrentTerminal border between the edge and the children
+        QRegion borderRegion() const;
+
     private slots:
         void term_termGetFocus();
         void term_termLostFocus();
@@ -23,10 +23,12 @@
 #include "termwidgetholder.h"
 #include "termwidget.h"
 #include "properties.h"
+#include "termhistory.h"
 #include <assert.h>
 
 
-TermWidgetHolder::TermWidgetHolder(const QString & wdir, const QString & shell, QWidget * parent)
+TermWidgetHolder::TermWidgetHolder(const QString & wdir, const QString & shell, QWidget * parent,
+                                   const QString & restoreFile)
     : QWidget(parent),
       m_wdir(wdir),
       m_shell(shell),
@@ -39,7 +41,7 @@ TermWidgetHolder::TermWidgetHolder(const QString & wdir, const QString & shell,
 
     QSplitter *s = new QSplitter(this);
     s->setFocusPolicy(Qt::NoFocus);
-    TermWidget *w = newTerm();
+    TermWidget *w = newTerm(QString(), QString(), restoreFile);
     s->addWidget(w);
     lay->addWidget(s);
 
@@ -175,6 +177,7 @@ void TermWidgetHolder::switchPrevSubterminal()
 void TermWidgetHolder::clearActiveTerminal()
 {
     currentTerminal()->impl()->clear();
+    currentTerminal()->impl()->history()->clear();
 }
 
 void TermWidgetHolder::propertiesChanged()
@@ -183,6 +186,12 @@ void TermWidgetHolder::propertiesChanged()
         w->propertiesChanged();
 }
 
+void TermWidgetHolder::trimHistory(int lines)
+{
+    foreach(TermWidget *w, findChildren<TermWidget*>())
+        w->impl()->trimHistory(lines);
+}
+
 void TermWidgetHolder::splitHorizontal(TermWidget * term)
 {
     split(term, Qt::Vertical);
@@ -222,7 +231,8 @@ void TermWidgetHolder::splitCollapse(TermWidget * term)
         emit finished();
 }
 
-void TermWidgetHolder::split(TermWidget *term, Qt::Orientation orientation)
+TermWidget * TermWidgetHolder::split(TermWidget *term, Qt::Orientation orientation, const QString & wdir,
+                                     const QString & restoreFile)
 {
     QSplitter *parent = qobject_cast<QSplitter *>(term->parent());
     assert(parent);
@@ -239,14 +249,18 @@ void TermWidgetHolder::split(TermWidget *term, Qt::Orientation orientation)
 
     // wdir settings
     QString wd(m_wdir);
-    if (Properties::Instance()->useCWD)
+    if (!wdir.isEmpty())
+    {
+        wd = wdir;
+    }
+    else if (Properties::Instance()->useCWD)
     {
         wd = term->impl()->workingDirectory();
         if (wd.isEmpty())
             wd = m_wdir;
     }
 
-    TermWidget * w = newTerm(wd);
+    TermWidget * w = newTerm(wd, QString(), restoreFile);
     s->insertWidget(1, w);
     s->setSizes(sizes);
 
@@ -254,9 +268,10 @@ void TermWidgetHolder::split(TermWidget *term, Qt::Orientation orientation)
     parent->setSizes(parentSizes);
 
     w->setFocus(Qt::OtherFocusReason);
+    return w;
 }
 
-TermWidget *TermWidgetHolder::newTerm(const QString & wdir, const QString & shell)
+TermWidget *TermWidgetHolder::newTerm(const QString & wdir, const QString & shell, const QString & restoreFile)
 {
     QString wd(wdir);
     if (wd.isEmpty())
@@ -266,7 +281,7 @@ TermWidget *TermWidgetHolder::newTerm(const QString & wdir, const QString & shel
     if (shell.isEmpty())
         sh = m_shell;
 
-    TermWidget *w = new TermWidget(wd, sh, this);
+    TermWidget *w = new TermWidget(wd, sh, this, restoreFile);
     // proxy signals
     connect(w, SIGNAL(renameSession()), this, SIGNAL(renameSession()));
     connect(w, SIGNAL(removeCurrentSession()), this, SIGNAL(lastTerminalClosed()));
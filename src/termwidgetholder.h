@@ -38,7 +38,9 @@ class TermWidgetHolder : public QWidget
     Q_OBJECT
 
     public:
-        TermWidgetHolder(const QString & wdir, const QString & shell=QString(), QWidget * parent=0);
+        //! The first terminal loads the saved history in \a restoreFile, if any
+        TermWidgetHolder(const QString & wdir, const QString & shell=QString(), QWidget * parent=0,
+                         const QString & restoreFile=QString());
         ~TermWidgetHolder();
 
         void propertiesChanged();
@@ -48,8 +50,15 @@ class TermWidgetHolder : public QWidget
         void saveSession(const QString & name);
         void zoomIn(uint step);
         void zoomOut(uint step);
+        void trimHistory(int lines);
 
         TermWidget* currentTerminal();
+        /*! Split \a term, the new terminal starts in \a wdir (by default
+            the directory of \a term or of the holder, see useCWD) and
+            loads the saved history in \a restoreFile
+         */
+        TermWidget * split(TermWidget * term, Qt::Orientation orientation, const QString & wdir = QString(),
+                           const QString & restoreFile = QString());
 
     public slots:
         void splitHorizontal(TermWidget * term);
@@ -72,8 +81,8 @@ class TermWidgetHolder : public QWidget
         QString m_shell;
         TermWidget * m_currentTerm;
 
-        void split(TermWidget * term, Qt::Orientation orientation);
-        TermWidget * newTerm(const QString & wdir=QString(), const QString & shell=QString());
+        TermWidget * newTerm(const QString & wdir=QString(), const QString & shell=QString(),
+                             const QString & restoreFile=QString());
 
     private slots:
         void setCurrentTerminal(TermWidget* term);
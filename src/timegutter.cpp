@@ -0,0 +1,97 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QPainter>
+#include <QDateTime>
+#include <QScrollBar>
+
+#include "timegutter.h"
+#include "termwidget.h"
+#include "termhistory.h"
+#include "properties.h"
+
+// the terminal draws its first line this far from the top
+#define TERMINAL_TOP_MARGIN 1
+
+
+TimeGutter::TimeGutter(TermWidgetImpl * term, QWidget * parent)
+    : QWidget(parent),
+      m_term(term)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(100);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(update()));
+
+    connect(term->history(), SIGNAL(linesAdded(qint64,int)), this, SLOT(scheduleUpdate()));
+    QScrollBar * scrollBar = term->findChild<QScrollBar*>();
+    if (scrollBar)
+        connect(scrollBar, SIGNAL(valueChanged(int)), this, SLOT(scheduleUpdate()));
+
+    setToolTip(tr("Arrival time of the lines, click to switch between time and delay"));
+}
+
+QSize TimeGutter::sizeHint() const
+{
+    QFontMetrics metrics(m_term->getTerminalFont());
+    return QSize(metrics.width("00:00:00.000") + 8, 0);
+}
+
+void TimeGutter::scheduleUpdate()
+{
+    if (isVisible() && !m_timer.isActive())
+        m_timer.start();
+}
+
+void TimeGutter::paintEvent(QPaintEvent *)
+{
+    QPainter p(this);
+    p.fillRect(rect(), palette().color(QPalette::Window));
+
+    QFont font = m_term->getTerminalFont();
+    QFontMetrics metrics(font);
+    p.setFont(font);
+    p.setPen(palette().color(QPalette::Disabled, QPalette::WindowText));
+
+    bool relative = Properties::Instance()->timestampGutterRelative;
+    TermHistory * history = m_term->history();
+    int rows = m_term->screenLinesCount();
+    qint64 previous = 0;
+    for (int row = -1; row < rows; ++row)
+    {
+        qint64 line = m_term->historyLineAtRow(row);
+        qint64 time = line < history->endLine() ? history->lineTime(line) : 0;
+        if (row >= 0 && time)
+        {
+            QString text;
+            if (!relative)
+                text = QDateTime::fromMSecsSinceEpoch(time).toString("hh:mm:ss.zzz");
+            else if (previous)
+                text = QString("+%1").arg((time - previous) / 1000.0, 0, 'f', 3);
+
+            QRect r(0, TERMINAL_TOP_MARGIN + row * metrics.height(), width() - 4, metrics.height());
+            p.drawText(r, Qt::AlignRight | Qt::AlignVCenter, text);
+        }
+        previous = time;
+    }
+}
+
+void TimeGutter::mousePressEvent(QMouseEvent *)
+{
+    Properties::Instance()->timestampGutterRelative = !Properties::Instance()->timestampGutterRelative;
+    update();
+}
@@ -0,0 +1,56 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Petr Vanek                                      *
+ *   petr@scribus.info                                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef TIMEGUTTER_H
+#define TIMEGUTTER_H
+
+#include <QWidget>
+#include <QTimer>
+
+class TermWidgetImpl;
+
+
+/*! \brief Shows when the visible lines of a terminal arrived.
+
+The times come from TermHistory::lineTime(). Clicking the gutter switches
+between the time of day and the delay since the previous line. Repaints
+are batched, so a busy terminal doesn't repaint the gutter on every chunk
+of output.
+*/
+class TimeGutter : public QWidget
+{
+    Q_OBJECT
+
+    public:
+        explicit TimeGutter(TermWidgetImpl * term, QWidget * parent = 0);
+
+        QSize sizeHint() const;
+
+    public slots:
+        void scheduleUpdate();
+
+    protected:
+        void paintEvent(QPaintEvent * event);
+        void mousePressEvent(QMouseEvent * event);
+
+    private:
+        TermWidgetImpl * m_term;
+        QTimer m_timer;
+};
+
+#endif